@@ -12,18 +12,36 @@
 */
 
 // for standard c libraries
-#include <errno.h>
-#include <dirent.h>
+#include <stdio.h>
+#include <signal.h>
+#include <getopt.h>
 #include <unistd.h>
-#include <fnmatch.h>
 
 #include <abitag.h>
+#include <abiarena.h>
+#include <abicatalog.h>
+#include <abicol.h>
+#include <abicompress.h>
+#include <abicsv.h>
 #include <abifile.h>
+#include <abilod.h>
+#include <abiplate.h>
+#include <abipool.h>
+#include <abiprefetch.h>
+#include <abiseparate.h>
+#include <abistate.h>
+#include <abistats.h>
+#include <abiwalk.h>
+#include <abiwatch.h>
 
 // for c++ standard template library
+#include <map>
+#include <algorithm>
 #include <list>
+#include <mutex>
+#include <atomic>
 #include <string>
-#include <fstream>
+#include <vector>
 #include <iostream>
 
 using namespace std;
@@ -31,163 +49,623 @@ using namespace std;
 //#define _DEBUG
 
 /*
- * platform dependent implementation
+ * command line settings
 */
-#ifdef _WIN32
-    #include <windows.h>
-#else
-    #include <dirent.h>
-    #include <sys/types.h>
-#endif
+struct OPTION
+{
+    int nJobs = 1;              // number of workers
+    int nWindow = 0;            // files read ahead of the workers; 0 for none
+    bool bCSV = true;           // write _raw.csv and _peak.csv
+    bool bColumn = false;       // write the columnar binary file
+    bool bPyramid = false;      // add the min/max pyramids to the columnar file
+    bool bPlate = false;        // one container per folder instead of files per trace
+    AbiLoadMode nMode = abiMAPPED;  // how the tracefiles are read
+    bool bMetadata = false;     // write one table of tags instead of converting
+    vector< pair<unsigned int, int> > vTag;     // tags in the table
+    vector<string> vTagName;    // their column captions
+    string szOutput;            // the metadata table
+    string szCatalog;           // catalog kept for the metadata; none if empty
+    string szState;             // convert only the files changed since; none if empty
+    bool bHash = false;         // compare the contents of the files as well
+    bool bStats = false;        // time the stages and print a summary
+    string szStats;             // the same summary as JSON; none if empty
+    AbiCompression nCompress = abiCOMPRESS_NONE;    // how the CSV files are compressed
+    int nLevel = 0;             // compression level
+    string szSuffix;            // added to the names of the compressed files
+    bool bWatch = false;        // keep converting files as they are written
+    int nSettle = 200;          // ms a written file is left alone before it is converted
+    bool bSeparate = false;     // add the dyes separated with the MTRX matrix
+    int nBaseline = 0;          // window of the baseline removed first; 0 for none
+};
+
+// the watcher of the daemon mode, stopped by SIGINT and SIGTERM
+static AbiWatcher* pWatcher = NULL;
 
-const unsigned int BUFFER_SIZE = 4192;
+static void OnSignal(
+    int )
+{
+    if ( pWatcher )
+    {
+        pWatcher->Stop();
+    }
+}
 
 /*
- * get the list of filenames that match the pattern
+ * everything a worker reuses from one file to the next
 */
-bool GetFilename(
-    list<string>& _list,        // list of filename in given directory
-    const string& _pattern )    // filename patterns
+struct WORKER
 {
-#ifdef _WIN32
-    // for Win32 implementation
-    WIN32_FIND_DATA stFindData;
-    HANDLE          hFindFile;
+    AbiFile abi;
+    AbiArena arena;                         // the signals of the current file
+    pmr::list<SIGNAL> signal{ &arena };
+    vector<PEAKTABLE> peak;
+    AbiPlan plan;
+    string szFilename;
+    string szTemp;                          // szFilename while it is written
+    AbiCsvWriter csv;
+    AbiColumnWriter col;
+    vector<AbiPyramid> lod;                 // one per signal, reused
+    pmr::vector<int> matrix;                // MTRX of the current file
+    AbiSeparator separator;
+    vector<string> text;                    // tags of the metadata mode
+    vector<bool> found;                     // which of them the file has
+    ABICATALOGENTRY entry;
+    AbiStats stats;                         // merged after the last file
+};
 
-    // find the first file
-    hFindFile = FindFirstFile( _pattern, &stFindData );
+/*
+ * print the per-file messages in the order the files were queued, no matter
+ * which worker finishes first
+*/
+class Progress
+{
+public:
+    Progress() : nNext( 0 ), nFailed( 0 ) {}
 
-    // search all files that match the pattern
-    do {
-        // make sure it is not a directory
-        if ( !( stFindData.cFileName[ 0 ] == '.' ) )
+    void Report( size_t _seq, const string& _msg, bool _ok )
+    {
+        lock_guard<mutex> lock( mLock );
+
+        mpMessage[ _seq ] = _msg;
+        nFailed += !_ok;
+
+        for ( map<size_t, string>::iterator i = mpMessage.begin();
+            !( i == mpMessage.end() ) && ( *i ).first == nNext; i = mpMessage.begin() )
         {
-            _list.push_back( stFindData.cFileName );
+            cout << ( *i ).second << endl;
+            mpMessage.erase( i ); ++nNext;
         }
+    }
 
-        FindNextFile( hFindFile, &stFindData );     // search for all matched files
-    } while ( !( GetLastError() == ERROR_NO_MORE_FILES ) );
+    size_t GetFailed() const    { return( nFailed ); }
 
-    FindClose( hFindFile );
+private:
+    mutex mLock;
+    map<size_t, string> mpMessage;  // finished out of order, not printed yet
+    size_t nNext;                   // next message to print
+    size_t nFailed;
+};
 
-#else
-    // for other implementations
-    struct dirent *st_dir;
-    char buffer[ BUFFER_SIZE ]; string file;
-    DIR *p_dir = opendir( "." );
+/*
+ * the containers of the plate mode, one per folder, opened when the first
+ * trace of the folder is converted and closed after the last
+*/
+class Plates
+{
+public:
+    // the container of the folder _file is in; it fails to add if it cannot be created
+    AbiPlateWriter& Get( const string& _file )
+    {
+        size_t slash = _file.rfind( '/' );
+        string folder( _file, 0, ( slash == string::npos ) ? 0 : slash );
+
+        lock_guard<mutex> lock( mLock );
+        map<string, AbiPlateWriter>::iterator i = mpPlate.find( folder );
+
+        if ( i == mpPlate.end() )
+        {
+            size_t name = folder.rfind( '/' );
+            string file = folder.empty() ? "plate.abiplate" :
+                folder + "/" + folder.substr( ( name == string::npos ) ? 0 : name + 1 ) + ".abiplate";
 
-    if ( !p_dir )
+            i = mpPlate.emplace( piecewise_construct, forward_as_tuple( folder ), forward_as_tuple() ).first;
+            ( *i ).second.Open( file );
+        }
+
+        return( ( *i ).second );
+    }
+
+    // write the tables of contents; the number of containers that failed
+    size_t Close()
+    {
+        lock_guard<mutex> lock( mLock );
+        size_t failed = 0;
+
+        for ( map<string, AbiPlateWriter>::iterator i = mpPlate.begin(); !( i == mpPlate.end() ); ++i )
+        {
+            failed += !( *i ).second.Close();
+        }
+
+        return( failed );
+    }
+
+    size_t GetCount() const     { return( mpPlate.size() ); }
+
+private:
+    mutex mLock;
+    map<string, AbiPlateWriter> mpPlate;    // by folder
+};
+
+/*
+ * the rows of the metadata table, kept in the order the files were queued
+ * and written once every file has been read
+*/
+class Metadata
+{
+public:
+    void Set( size_t _seq, const string& _file, const vector<string>& _value, const vector<bool>& _found )
     {
-        cout << "directory cannot be opened" << endl; return( false );
-    }   // make sure the directory can be opened successfully
+        lock_guard<mutex> lock( mLock );
 
-    while ( st_dir = readdir( p_dir ) )
+        if ( !( _seq < vRow.size() ) )
+        {
+            vRow.resize( _seq + 1 ); vFound.resize( _seq + 1 );
+        }
+
+        vRow[ _seq ].push_back( _file );
+        vRow[ _seq ].insert( vRow[ _seq ].end(), _value.begin(), _value.end() );
+        vFound[ _seq ].assign( 1, true );
+        vFound[ _seq ].insert( vFound[ _seq ].end(), _found.begin(), _found.end() );
+    }
+
+    // one row per file with the file name first; missing tags are left empty
+    bool Write( const OPTION& _opt, AbiCsvWriter& _csv )
     {
-        if ( st_dir->d_name[ 0 ] == '.' )
+        if ( !_csv.Open( _opt.szOutput.c_str() ) )
+        {
+            return( false );
+        }
+
+        _csv.PutQuoted( "File" );
+
+        for ( size_t i = 0; i < _opt.vTagName.size(); ++i )
         {
-            continue;
-        }   // skip the root directories and hidden files
+            _csv.Put( ',' ); _csv.PutQuoted( _opt.vTagName[ i ].c_str() );
+        }
+
+        _csv.Put( '\n' );
 
-        if ( st_dir->d_type == DT_DIR )
+        for ( size_t i = 0; i < vRow.size(); ++i )
         {
-            chdir( st_dir->d_name );    // change to the next directory
-            GetFilename( _list, _pattern );
-            chdir( ".." );              // revert back to the previous directory
-            continue;
-        }   // recursively search each directory
+            for ( size_t k = 0; k < vRow[ i ].size(); ++k )
+            {
+                if ( k > 0 )
+                {
+                    _csv.Put( ',' );
+                }
+
+                if ( vFound[ i ][ k ] )
+                {
+                    _csv.PutQuoted( vRow[ i ][ k ].c_str() );
+                }
+            }
 
-        if ( fnmatch( _pattern.c_str(), st_dir->d_name, FNM_FILE_NAME | FNM_PERIOD ) == FNM_NOMATCH )
+            if ( !vRow[ i ].empty() )
+            {
+                _csv.Put( '\n' );
+            }
+        }
+
+        return( _csv.Close() );
+    }
+
+private:
+    mutex mLock;
+    vector< vector<string> > vRow;  // empty for the files that failed
+    vector< vector<bool> > vFound;  // one per cell of vRow; false for a missing tag
+};
+
+/*
+ * read the metadata tags of a tracefile: from the catalog if there is one
+ * and the file has not changed, otherwise only the header, the directory and
+ * the payloads of the tags
+*/
+bool ReadMetadata(
+    const OPTION& _opt, WORKER& _w, AbiCatalog* _catalog, const string& _file, string& _msg )
+{
+    AbiTimer timer( _opt.bStats ? &_w.stats : NULL, abiSTAGE_FILE );
+
+    _msg = "reading file " + _file + "...";
+    _w.text.resize( _opt.vTag.size() ); _w.found.assign( _opt.vTag.size(), false );
+
+    if ( _catalog )
+    {
+        if ( !_catalog->Lookup( _file, _w.abi, _w.entry ) )
         {
-            continue;
-        }   // search for files with specific patterns
+            _msg.append( " failed to load" ); return( false );
+        }
 
-        // put together the path and filename
-        file.assign( getcwd( buffer, BUFFER_SIZE ) );
-        file.append( "/" ); file.append( st_dir->d_name );
+        for ( size_t i = 0; i < _opt.vTag.size(); ++i )
+        {
+            const ABICATALOGTAG* tag = _w.entry.FindTag( _opt.vTag[ i ].first, _opt.vTag[ i ].second );
+            _w.found[ i ] = tag && ( *tag ).bFound;
+            _w.text[ i ].assign( _w.found[ i ] ? ( *tag ).szValue : "" );
+        }
 
-        _list.push_back( file );
-    }   // scan through the entire directory
+        _msg.append( " done" ); return( true );
+    }
 
-    closedir( p_dir );
-#endif
+    if ( !_w.abi.LoadFile( _file.c_str(), abiLAZY ) )
+    {
+        _msg.append( " failed to load (" + string( AbiFile::GetErrorText( _w.abi.GetError() ) ) + ")" );
+        return( false );
+    }
+
+    _w.plan.Clear();
+
+    for ( size_t i = 0; i < _opt.vTag.size(); ++i )
+    {
+        _w.plan.AddText( _opt.vTag[ i ].first, _opt.vTag[ i ].second, _w.text[ i ] );
+    }
+
+    _w.abi.Extract( _w.plan );
+
+    for ( size_t i = 0; i < _opt.vTag.size(); ++i )
+    {
+        _w.found[ i ] = _w.plan.IsFound( i );
+    }
+
+    _msg.append( " done (" + to_string( _w.abi.GetBytesRead() ) + " of " +
+        to_string( _w.abi.GetFileSize() ) + " bytes)" );
 
     return( true );
-}   // end of GetFilename()
+}   // end of ReadMetadata()
 
-bool WriteCSV(
-    string& _filename,
-    list<SIGNAL>& _signal )
+/*
+ * outputs are written under a temporary name and renamed once complete, so an
+ * interrupted run leaves either the old file or the new one, never a part
+*/
+void SetOutput(
+    WORKER& _w, const string& _file, size_t _base, const char* _suffix, const string& _compress )
 {
-    ofstream csv( _filename.c_str(), ios::out | ios::trunc );
+    _w.szFilename.assign( _file, 0, _base ).append( _suffix ).append( _compress );
+    _w.szTemp.assign( _w.szFilename ).append( ".tmp" );
+}
 
-    if ( !csv )
+bool CommitOutput(
+    WORKER& _w, bool _written )
+{
+    if ( _written && !rename( _w.szTemp.c_str(), _w.szFilename.c_str() ) )
+    {
+        return( true );
+    }
+
+    unlink( _w.szTemp.c_str() );
+
+    return( false );
+}
+
+/*
+ * incremental mode: the file is unchanged since it was last converted and
+ * every output it would be converted into is there
+*/
+bool IsUpToDate(
+    const OPTION& _opt, AbiState& _state, const string& _file )
+{
+    size_t base = _file.rfind( '.' );
+    string name( _file, 0, base );
+
+    if ( !_state.Check( _file ) )
     {
         return( false );
     }
 
-    list<SIGNAL>::iterator filter;
+    return( ( !_opt.bCSV || ( !access( ( name + "_raw.csv" + _opt.szSuffix ).c_str(), F_OK ) &&
+        !access( ( name + "_peak.csv" + _opt.szSuffix ).c_str(), F_OK ) ) ) &&
+        ( !_opt.bColumn || !access( ( name + ".abicol" ).c_str(), F_OK ) ) );
+}
 
-    // first write all the captions
-    filter = _signal.begin();
-    csv << "\"" << ( *filter ).szCaption.c_str() << "\"";
+/*
+ * the raw channels from _raw on, separated into dyes with the MTRX matrix of
+ * the file and added to the signals as Dye 1 to Dye n; false if the matrix
+ * is missing or does not fit the raw channels
+*/
+bool SeparateDyes(
+    WORKER& _w, pmr::list<SIGNAL>::iterator _raw )
+{
+    const int* src[ abiSEPARATEMAX ];
+    int* dst[ abiSEPARATEMAX ];
+    int n = 0;
 
-    for ( ++filter; !( filter == _signal.end() ); ++filter )
+    if ( !_w.separator.SetMatrix( _w.matrix.data(), _w.matrix.size() ) ||
+        !( static_cast<int>( distance( _raw, _w.signal.end() ) ) == _w.separator.GetChannelCount() ) )
     {
-        csv << ",\"" << ( *filter ).szCaption.c_str() << "\"";
+        return( false );
     }
 
-    csv << endl;
+    size_t count = ( *_raw ).vSignal.size();
+
+    for ( ; !( _raw == _w.signal.end() ); ++_raw, ++n )
+    {
+        src[ n ] = ( *_raw ).vSignal.data();
+        count = min( count, ( *_raw ).vSignal.size() );
+    }
 
-    // now write all the data
-    for ( unsigned int i = 0; i < ( _signal.front() ).vSignal.size(); ++i )
+    for ( int d = 0; d < n; ++d )
     {
-        filter = _signal.begin();
-        csv << static_cast<int>( ( *filter ).vSignal[ i ] );
+        _w.signal.emplace_back();
+        _w.signal.back().szCaption = "Dye " + to_string( d + 1 );
+        _w.signal.back().vSignal.resize( count );
+        dst[ d ] = _w.signal.back().vSignal.data();
+    }
+
+    _w.separator.Separate( src, dst, count );
+
+    return( true );
+}
+
+/*
+ * write the raw signal and peak files of a loaded tracefile
+*/
+bool ExportFile(
+    const OPTION& _opt, WORKER& _w, Plates* _plates, const string& _file, string& _msg )
+{
+    size_t base = _file.rfind( '.' );
+    int sample = -1, lane = -1;
+    bool separated = true;
+
+    // everything is decoded in one pass, in the order it is stored in the file
+    _w.signal.clear(); _w.arena.Reset(); _w.plan.Clear();
+    _w.abi.GetGSData( _w.signal, _w.plan );
+
+    size_t analyzed = _w.signal.size();
+
+    _w.abi.GetCCDData( _w.signal, _w.plan );
+    _w.abi.GetPeakTable( _w.peak, _w.plan );
 
-        for ( ++filter; !( filter == _signal.end() ); ++filter )
+    if ( _opt.bSeparate )
+    {
+        _w.matrix.clear();
+        _w.plan.AddLong( abiFLAGMTRX, 1, _w.matrix );
+    }
+
+    if ( _plates )
+    {
+        _w.text.resize( 2 );
+        sample = _w.plan.AddText( AbiFlagCode( "SpNm" ), 1, _w.text[ 0 ] );
+        lane = _w.plan.AddText( AbiFlagCode( "LANE" ), 1, _w.text[ 1 ] );
+    }
+
+    _w.abi.Extract( _w.plan );
+
+    if ( _opt.bSeparate )
+    {
+        separated = SeparateDyes( _w, next( _w.signal.begin(), analyzed ) );
+    }
+
+    if ( _opt.bCSV )
+    {
+        SetOutput( _w, _file, base, "_raw.csv", _opt.szSuffix );
+
+        if ( !CommitOutput( _w, _w.csv.WriteCSV( _w.szTemp, _w.signal ) ) )
+        {
+            _msg.append( " file writing error" ); return( false );
+        }
+
+        SetOutput( _w, _file, base, "_peak.csv", _opt.szSuffix );
+
+        if ( !CommitOutput( _w, _w.csv.WriteCSV( _w.szTemp, _w.peak ) ) )
         {
-            csv << "," << static_cast<int>( ( *filter ).vSignal[ i ] );
+            _msg.append( " file writing error" ); return( false );
         }
+    }
 
-        csv << endl;
+    if ( _opt.bColumn || _plates )
+    {
+        _w.col.Clear();
+        _w.col.AddSignal( _w.signal ); _w.col.AddPeak( _w.peak );
+
+        if ( _opt.bPyramid )
+        {
+            pmr::list<SIGNAL>::iterator i = _w.signal.begin();
+            _w.lod.resize( _w.signal.size() );
+
+            // table "lod DATA 9" goes with column "DATA 9" of table "signal"
+            for ( size_t k = 0; k < _w.lod.size(); ++k, ++i )
+            {
+                _w.lod[ k ].Build( ( *i ).vSignal.data(), ( *i ).vSignal.size() );
+                _w.col.AddPyramid( "lod " + AbiColumnWriter::GetSignalName( *i ), _w.lod[ k ] );
+            }
+        }
     }
 
-    csv.close(); return( true );
+    if ( _opt.bColumn )
+    {
+        // left as it is, so it can still be mapped
+        SetOutput( _w, _file, base, ".abicol", "" );
+
+        if ( !CommitOutput( _w, _w.col.Write( _w.szTemp ) ) )
+        {
+            _msg.append( " file writing error" ); return( false );
+        }
+    }
+
+    if ( _plates )
+    {
+        size_t slash = _file.rfind( '/' );
+        string name( _file, ( slash == string::npos ) ? 0 : slash + 1 );
+
+        if ( !_plates->Get( _file ).Add( name, _w.plan.IsFound( sample ) ? _w.text[ 0 ] : "",
+            _w.plan.IsFound( lane ) ? atoi( _w.text[ 1 ].c_str() ) : -1, _w.col ) )
+        {
+            _msg.append( " file writing error" ); return( false );
+        }
+    }
+
+    _msg.append( separated ? " done" : " done (no usable MTRX)" );
+
+    if ( _opt.nMode == abiLAZY )
+    {
+        _msg.append( " (" + to_string( _w.abi.GetBytesRead() ) + " of " +
+            to_string( _w.abi.GetFileSize() ) + " bytes in " +
+            to_string( _w.abi.GetReadCount() ) + " reads)" );
+    }
+
+    return( true );
 }
 
-bool WriteCSV(
-    string& _filename,
-    list<PEAK>& _peak )
+/*
+ * convert one tracefile into the raw signal and peak files
+*/
+bool ConvertFile(
+    const OPTION& _opt, WORKER& _w, Plates* _plates, const string& _file, string& _msg )
 {
-    ofstream csv( _filename.c_str(), ios::out | ios::trunc );
+    AbiTimer timer( _opt.bStats ? &_w.stats : NULL, abiSTAGE_FILE );
+
+    _msg = "processing file " + _file + "...";
 
-    if ( !csv )
+    if ( !_w.abi.LoadFile( _file.c_str(), _opt.nMode ) )
     {
+        _msg.append( " failed to load (" + string( AbiFile::GetErrorText( _w.abi.GetError() ) ) + ")" );
         return( false );
     }
 
-    list<PEAK>::iterator peak;
+    timer.Set( _w.abi.GetFileSize(), 0 );
+
+    return( ExportFile( _opt, _w, _plates, _file, _msg ) );
+}
+
+/*
+ * convert a tracefile the prefetcher has read; the worker takes the buffer
+*/
+bool ConvertFile(
+    const OPTION& _opt, WORKER& _w, Plates* _plates, ABIPREFETCH& _file, string& _msg )
+{
+    AbiTimer timer( _opt.bStats ? &_w.stats : NULL, abiSTAGE_FILE );
+
+    _msg = "processing file " + _file.szFilename + "...";
 
-    for ( peak = _peak.begin(); !( peak == _peak.end() ); ++peak )
+    if ( !_w.abi.LoadBuffer( _file.szBuffer, _file.nSize, _file.nError, _file.nErrno ) )
     {
-        // first write the filter name
-        csv << "\"" << ( *peak ).szCaption.c_str() << "\"" << endl;
-        csv << "\"Position\",\"Height\",\"BeginPeak\",\"EndPeak\",";
-        csv << "\"BeginHeight\",\"EndHeight\",\"Area\",\"Size\"" << endl;
+        _msg.append( " failed to load (" + string( AbiFile::GetErrorText( _w.abi.GetError() ) ) + ")" );
+        return( false );
+    }
+
+    timer.Set( _w.abi.GetFileSize(), 0 );
+
+    return( ExportFile( _opt, _w, _plates, _file.szFilename, _msg ) );
+}
+
+/*
+ * parse a comma separated list of output formats
+*/
+bool SetFormat(
+    OPTION& _opt, const string& _format )
+{
+    size_t begin = 0, end;
 
-        list<PEAKDATA>::iterator p;
+    _opt.bCSV = _opt.bColumn = _opt.bPyramid = _opt.bPlate = false;
 
-        // now, write all the data
-        for ( p = ( *peak ).lpPeak.begin(); !( p == ( *peak ).lpPeak.end() ); ++p )
+    do {
+        end = _format.find( ',', begin );
+        string name( _format, begin, ( end == string::npos ) ? string::npos : end - begin );
+
+        if ( name == "csv" )
+        {
+            _opt.bCSV = true;
+        }
+        else if ( name == "col" )
+        {
+            _opt.bColumn = true;
+        }
+        else if ( name == "lod" )
+        {
+            _opt.bPyramid = true;
+        }
+        else if ( name == "plate" )
         {
-            csv << ( *p ).nPoint << "," << ( *p ).nHeight << ",";
-            csv << ( *p ).nBegin << "," << ( *p ).nEnd << ",";
-            csv << ( *p ).nBeginHi << "," << ( *p ).nEndHi << ",";
-            csv << ( *p ).nArea << "," << ( *p ).dSize << endl;
+            _opt.bPlate = true;
         }
+        else
+        {
+            return( false );
+        }
+
+        begin = end + 1;
+    } while ( !( end == string::npos ) );
+
+    // the pyramids go into the container if there is one, else a columnar file
+    _opt.bColumn = _opt.bColumn || ( _opt.bPyramid && !_opt.bPlate );
+
+    return( true );
+}
+
+/*
+ * parse the compression method with an optional level, as in gzip:9; the
+ * level defaults to 6 for gzip and 3 for zstd
+*/
+bool SetCompression(
+    OPTION& _opt, const string& _method )
+{
+    size_t colon = _method.find( ':' );
+    string name( _method, 0, colon );
+
+    if ( name == "gzip" )
+    {
+        _opt.nCompress = abiCOMPRESS_GZIP; _opt.nLevel = 6;
+    }
+    else if ( name == "zstd" )
+    {
+        _opt.nCompress = abiCOMPRESS_ZSTD; _opt.nLevel = 3;
+    }
+    else if ( name == "none" )
+    {
+        _opt.nCompress = abiCOMPRESS_NONE; _opt.nLevel = 0;
+    }
+    else
+    {
+        return( false );
+    }
+
+    if ( !( colon == string::npos ) )
+    {
+        _opt.nLevel = atoi( _method.c_str() + colon + 1 );
     }
 
-    csv.close(); return( true );
+    _opt.szSuffix = AbiCompressor::GetSuffix( _opt.nCompress );
+
+    return( ( _opt.nCompress == abiCOMPRESS_GZIP ) ? ( _opt.nLevel > 0 && _opt.nLevel < 10 ) :
+        ( _opt.nCompress == abiCOMPRESS_ZSTD ) ? ( _opt.nLevel > 0 && _opt.nLevel < 23 ) : true );
+}
+
+/*
+ * parse a comma separated list of tags, each a four letter flag with an
+ * optional id, as in SpNm,LANE,DATA:9; the id defaults to 1
+*/
+bool SetTags(
+    OPTION& _opt, const string& _list )
+{
+    size_t begin = 0, end;
+
+    _opt.bMetadata = true; _opt.vTag.clear(); _opt.vTagName.clear();
+
+    do {
+        end = _list.find( ',', begin );
+        string name( _list, begin, ( end == string::npos ) ? string::npos : end - begin );
+        size_t colon = name.find( ':' );
+        int fid = ( colon == string::npos ) ? 1 : atoi( name.c_str() + colon + 1 );
+
+        if ( !( name.substr( 0, colon ).length() == 4 ) || !( fid > 0 ) )
+        {
+            return( false );
+        }
+
+        _opt.vTag.push_back( make_pair( AbiFlagCode( name ), fid ) );
+        _opt.vTagName.push_back( name );
+        begin = end + 1;
+    } while ( !( end == string::npos ) );
+
+    return( true );
 }
 
 /*
@@ -195,57 +673,476 @@ bool WriteCSV(
 */
 int main( int argc, char** argv )
 {
+    OPTION opt;
+    int option;
+
+    // the long names of the options; --stats and --stats-json have no short one
+    const struct option longopt[] =
+    {
+        { "jobs", required_argument, NULL, 'j' },
+        { "prefetch", required_argument, NULL, 'p' },
+        { "format", required_argument, NULL, 'f' },
+        { "lazy", no_argument, NULL, 'l' },
+        { "incremental", required_argument, NULL, 'i' },
+        { "hash", no_argument, NULL, 'H' },
+        { "metadata", required_argument, NULL, 'm' },
+        { "output", required_argument, NULL, 'o' },
+        { "catalog", required_argument, NULL, 'c' },
+        { "compress", required_argument, NULL, 'z' },
+        { "watch", no_argument, NULL, 'w' },
+        { "settle", required_argument, NULL, 'T' },
+        { "separate", no_argument, NULL, 's' },
+        { "baseline", required_argument, NULL, 'B' },
+        { "stats", no_argument, NULL, 'S' },
+        { "stats-json", required_argument, NULL, 'J' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ( ( option = getopt_long( argc, argv, "j:p:f:lm:o:c:i:Hz:ws", longopt, NULL ) ) != -1 )
+    {
+        switch ( option )
+        {
+        case 'j':
+            opt.nJobs = atoi( optarg );
+            opt.nJobs = ( opt.nJobs > 0 ) ? opt.nJobs : AbiWorkPool::GetDefaultSize();
+            break;
+
+        case 'p':
+            opt.nWindow = max( atoi( optarg ), 0 );
+            break;
+
+        case 'f':
+            argc = SetFormat( opt, optarg ) ? argc : 0;
+            break;
+
+        case 'l':
+            opt.nMode = abiLAZY;
+            break;
+
+        case 'm':
+            argc = SetTags( opt, optarg ) ? argc : 0;
+            break;
+
+        case 'o':
+            opt.szOutput = optarg;
+            break;
+
+        case 'c':
+            opt.szCatalog = optarg;
+            break;
+
+        case 'i':
+            opt.szState = optarg;
+            break;
+
+        case 'H':
+            opt.bHash = true;
+            break;
+
+        case 'z':
+            argc = SetCompression( opt, optarg ) ? argc : 0;
+            break;
+
+        case 'w':
+            opt.bWatch = true;
+            break;
+
+        case 'T':
+            opt.nSettle = max( atoi( optarg ), 0 );
+            break;
+
+        case 's':
+            opt.bSeparate = true;
+            break;
+
+        case 'B':
+            opt.nBaseline = max( atoi( optarg ), 0 );
+            break;
+
+        case 'S':
+            opt.bStats = true;
+            break;
+
+        case 'J':
+            opt.bStats = true; opt.szStats = optarg;
+            break;
+
+        default:
+            argc = 0;
+        }
+    }
+
+    // the table and the containers are only written at the end
+    argc = ( opt.bWatch && ( opt.bMetadata || opt.bPlate ) ) ? 0 : argc;
+
     // make sure we have enough parameters
-    if ( argc < 2 )
+    if ( !( optind < argc ) )
     {
-        cout << "usage: " << argv[ 0 ] << " extension" << endl;
+        cout << "usage: " << argv[ 0 ] << " [-j jobs] [-p window] [-f formats] [-l] [-i state [-H]] [-z method] [-w] [-s [--baseline n]] extension [extension ...]" << endl;
+        cout << "       " << argv[ 0 ] << " [-j jobs] -m tags [-o output] [-c catalog] [-z method] extension [extension ...]" << endl;
         cout << "convert the ABI and AB1 files into CSV format" << endl;
+        cout << "  -j jobs     convert with this many workers; 0 for one per core" << endl;
+        cout << "  -p window   read this many files ahead of the workers" << endl;
+        cout << "  -f formats  comma separated list of csv (default), col, lod and plate" << endl;
+        cout << "  -l          read only the header, directory and exported tags" << endl;
+        cout << "  -i state    convert only the files changed since the state was saved" << endl;
+        cout << "  -H          with -i, also compare the contents of the files" << endl;
+        cout << "  -m tags     write the tags of every file into one table, e.g. SpNm,LANE,DATA:9" << endl;
+        cout << "  -o output   name of the table; metadata.csv by default" << endl;
+        cout << "  -c catalog  keep the tags in a catalog and read only new and changed files" << endl;
+        cout << "  -z method   compress the csv files with gzip or zstd, e.g. gzip:9 for level 9" << endl;
+        cout << "  -w          keep watching and convert the files as they are written; not with -m or plate" << endl;
+        cout << "  --settle ms with -w, convert a file once it has been left alone this long; 200 by default" << endl;
+        cout << "  -s          add the dyes separated from the raw channels with the MTRX matrix" << endl;
+        cout << "  --baseline n  with -s, remove the baseline under peaks narrower than n samples first" << endl;
+        cout << "  --stats     print the time, bytes and items of every stage and the time per file" << endl;
+        cout << "  --stats-json file  write the same as JSON" << endl;
+        cout << "the options have long names as well: --jobs, --prefetch, --format, --lazy," << endl;
+        cout << "--incremental, --hash, --metadata, --output, --catalog, --compress, --watch and --separate" << endl;
         exit( 1 );
     }
 
-    list<string> lpFile; lpFile.clear();
-    list<string>::iterator i;
-    string szFilename;
-    string szExtension( "*." ); szExtension.append( argv[ 1 ] );
+    Progress progress;
+    Metadata metadata;
+    AbiCatalog catalog;
+    AbiCatalog* pCatalog = NULL;
+    AbiState state( opt.bHash );
+    AbiState* pState = NULL;
+    Plates plates;
+    Plates* pPlates = opt.bPlate ? &plates : NULL;
+    atomic<size_t> seq( 0 ), current( 0 );
+    AbiStats stats;
+    uint64_t start = AbiGetClock();
 
-    GetFilename( lpFile, szExtension ); lpFile.sort();
+    opt.szOutput = opt.szOutput.empty() ? "metadata.csv" : opt.szOutput;
 
-    list<SIGNAL> signal; list<PEAK> peak;
+    if ( !AbiCompressor::IsAvailable( opt.nCompress ) )
+    {
+        cout << "this build cannot write " << opt.szSuffix << " files" << endl; exit( 1 );
+    }
+
+    // the table gets the suffix too, unless it was named with it
+    if ( !( opt.szOutput.length() > opt.szSuffix.length() &&
+        opt.szOutput.compare( opt.szOutput.length() - opt.szSuffix.length(), string::npos, opt.szSuffix ) == 0 ) )
+    {
+        opt.szOutput.append( opt.szSuffix );
+    }
+
+    // the blocks of every writer are compressed on one set of threads
+    AbiCompressor compressor( opt.nCompress, opt.nLevel, AbiWorkPool::GetDefaultSize() );
+
+    if ( opt.bMetadata && !opt.szCatalog.empty() )
+    {
+        pCatalog = &catalog;
+        catalog.ClearTags();
+
+        for ( size_t i = 0; i < opt.vTag.size(); ++i )
+        {
+            catalog.AddTag( opt.vTag[ i ].first, opt.vTag[ i ].second );
+        }
+
+        // a damaged catalog is rebuilt from the files
+        if ( !catalog.Load( opt.szCatalog ) )
+        {
+            cout << "catalog " << opt.szCatalog << " is damaged and will be rebuilt" << endl;
+        }
+    }
+
+    // a container holds every trace of its folder, so it is always rebuilt;
+    // the daemon keeps the state in memory to skip files it has converted
+    if ( !opt.bMetadata && !opt.bPlate && ( opt.bWatch || !opt.szState.empty() ) )
+    {
+        pState = &state;
+
+        if ( !opt.szState.empty() && !state.Load( opt.szState ) )
+        {
+            cout << "state " << opt.szState << " is damaged; all files are converted" << endl;
+        }
+    }
+
+    {
+        AbiWorkPool pool( opt.nJobs );
+        vector<WORKER> worker( pool.GetSize() );
+
+        for ( size_t i = 0; opt.bStats && i < worker.size(); ++i )
+        {
+            worker[ i ].abi.SetStats( &worker[ i ].stats );
+            worker[ i ].csv.SetStats( &worker[ i ].stats );
+            worker[ i ].col.SetStats( &worker[ i ].stats );
+            worker[ i ].separator.SetStats( &worker[ i ].stats );
+        }
 
+        for ( size_t i = 0; opt.bSeparate && i < worker.size(); ++i )
+        {
+            worker[ i ].separator.SetBaseline( opt.nBaseline );
+        }
+
+        for ( size_t i = 0; !( opt.nCompress == abiCOMPRESS_NONE ) && i < worker.size(); ++i )
+        {
+            worker[ i ].csv.SetCompressor( &compressor );
+        }
+
+        // read files ahead and hand them to the workers as the reads complete;
+        // the slot is held until the file has been written
+        AbiPrefetcher prefetch( max( opt.nWindow, 1 ), [ & ]( ABIPREFETCH& _file )
+        {
+            pool.Submit( [ &opt, &worker, &progress, &prefetch, pState, pPlates, _file ]( int _id ) mutable
+            {
+                string msg;
+                bool ok = ConvertFile( opt, worker[ _id ], pPlates, _file, msg );
+
+                if ( ok && pState )
+                {
+                    pState->Commit( _file.szFilename );
+                }
+
+                prefetch.Release();
+                progress.Report( _file.nSeq, msg, ok );
+            } );
+        }, opt.nWindow > 0 );
+
+        // the walk only gathers the files; they are numbered and queued in
+        // the order of their paths once it is over, since the directories
+        // are read in whatever order the workers get to them
+        vector<string> found;
+        mutex foundLock;
+
+        AbiDirWalker walker( pool, [ & ]( const string& _file )
+        {
 #ifdef _DEBUG
-    cout << "number of file(s): " << lpFile.size() << endl;
+            cout << "filename: " << _file << endl;
 #endif
 
-    for ( i = lpFile.begin(); !( i == lpFile.end() ); ++i )
-    {
-        szFilename = ( *i );
+            lock_guard<mutex> guard( foundLock );
+            found.push_back( _file );
+        } );
+
+        auto queue = [ & ]( const string& _file )
+        {
+            if ( opt.bMetadata )
+            {
+                size_t n = seq++;
+
+                pool.Submit( [ &opt, &worker, &progress, &metadata, pCatalog, _file, n ]( int _id )
+                {
+                    string msg;
+                    bool ok = ReadMetadata( opt, worker[ _id ], pCatalog, _file, msg );
+
+                    if ( ok )
+                    {
+                        metadata.Set( n, _file, worker[ _id ].text, worker[ _id ].found );
+                    }
+
+                    progress.Report( n, msg, ok );
+                } );
+
+                return;
+            }
+
+            // unchanged files are left out before they are read or numbered
+            if ( pState && IsUpToDate( opt, *pState, _file ) )
+            {
+                ++current; return;
+            }
+
+            size_t n = seq++;
+
+            if ( opt.nWindow > 0 )
+            {
+                prefetch.Add( _file, n ); return;
+            }
+
+            pool.Submit( [ &opt, &worker, &progress, pState, pPlates, _file, n ]( int _id )
+            {
+                string msg;
+                bool ok = ConvertFile( opt, worker[ _id ], pPlates, _file, msg );
+
+                if ( ok && pState )
+                {
+                    pState->Commit( _file );
+                }
+
+                progress.Report( n, msg, ok );
+            } );
+        };
+
+        // the time from the close of each file to its output, in the daemon mode
+        AbiStats arrival;
+        mutex lock;
+
+        AbiWatcher watcher( [ & ]( const string& _file, uint64_t _closed )
+        {
+            if ( IsUpToDate( opt, *pState, _file ) )
+            {
+                ++current; return;
+            }
+
+            size_t n = seq++;
+
+            pool.Submit( [ &opt, &worker, &progress, &arrival, &lock, pState, _file, _closed, n ]( int _id )
+            {
+                string msg = "processing file " + _file + "...";
+                bool ok;
+
+                // one bad file must not end the daemon
+                try
+                {
+                    ok = ConvertFile( opt, worker[ _id ], NULL, _file, msg );
+                }
+                catch ( const exception& _e )
+                {
+                    msg.append( string( " failed (" ) + _e.what() + ")" ); ok = false;
+                }
+
+                if ( ok )
+                {
+                    uint64_t latency = AbiGetClock() - _closed;
+
+                    pState->Commit( _file );
+                    msg.append( ", " + to_string( latency / 1000000 ) + " ms after close" );
+
+                    lock_guard<mutex> guard( lock );
+                    arrival.Add( abiSTAGE_FILE, latency, 0, 1 );
+                }
+
+                progress.Report( n, msg, ok );
+            } );
+        }, opt.nSettle );
+
+        for ( int i = optind; i < argc; ++i )
+        {
+            walker.AddPattern( string( "*." ) + argv[ i ] );
+            watcher.AddPattern( string( "*." ) + argv[ i ] );
+        }
+
+        // watch before the walk, so nothing written during the walk is missed
+        if ( opt.bWatch && !watcher.Watch( "." ) )
+        {
+            cout << "not every folder can be watched; check fs.inotify.max_user_watches" << endl;
+        }
+
+        if ( !walker.Walk( "." ) )
+        {
+            cout << "directory cannot be opened" << endl; exit( 1 );
+        }
+
+        pool.Wait();
+        sort( found.begin(), found.end() );
+
+        for ( size_t i = 0; i < found.size(); ++i )
+        {
+            queue( found[ i ] );
+        }
+
+        pool.Wait();
+        prefetch.Finish();
+        pool.Wait();
+
+        if ( walker.GetErrorCount() > 0 )
+        {
+            cout << walker.GetErrorCount() << " director(ies) cannot be opened" << endl;
+        }
+
+        if ( opt.bWatch )
+        {
+            pWatcher = &watcher;
+            signal( SIGINT, OnSignal ); signal( SIGTERM, OnSignal );
+
+            cout << "watching " << watcher.GetWatchCount() << " folder(s) for new files; interrupt to stop" << endl;
+            watcher.Run();
+            pool.Wait();
+
+            signal( SIGINT, SIG_DFL ); signal( SIGTERM, SIG_DFL );
+            pWatcher = NULL;
+
+            const ABISTAGE& file = arrival.GetStage( abiSTAGE_FILE );
+            char line[ 160 ];
+
+            snprintf( line, sizeof( line ), "%llu file(s) converted as they arrived; from close to output "
+                "p50 < %llu us, p90 < %llu us, max %llu us", static_cast<unsigned long long>( file.nCalls ),
+                static_cast<unsigned long long>( arrival.GetPercentile( 0.5 ) ),
+                static_cast<unsigned long long>( arrival.GetPercentile( 0.9 ) ),
+                static_cast<unsigned long long>( arrival.GetMaxLatency() ) );
+            cout << line << endl;
+
+            if ( watcher.GetOverflowCount() > 0 )
+            {
+                cout << "events were dropped " << watcher.GetOverflowCount() << " time(s); the folders were rescanned" << endl;
+            }
+        }
+
+        if ( opt.bMetadata && !metadata.Write( opt, worker[ 0 ].csv ) )
+        {
+            cout << "cannot write " << opt.szOutput << endl; exit( 1 );
+        }
+
+        if ( pCatalog && !catalog.Save( opt.szCatalog ) )
+        {
+            cout << "cannot write " << opt.szCatalog << endl;
+        }
+
+        if ( pCatalog )
+        {
+            cout << catalog.GetHitCount() << " file(s) from the catalog, " <<
+                catalog.GetMissCount() << " read" << endl;
+        }
+
+        if ( pPlates )
+        {
+            size_t failed = plates.Close();
+            cout << plates.GetCount() - failed << " container(s) written, " << failed << " failed" << endl;
+        }
+
+        if ( pState && !opt.szState.empty() && !state.Save( opt.szState ) )
+        {
+            cout << "cannot write " << opt.szState << endl;
+        }
+
+        if ( pState )
+        {
+            cout << current << " file(s) up to date" << endl;
+        }
 
 #ifdef _DEBUG
-        cout << "filename: " << ( *i ) << endl;
+        cout << "number of file(s): " << walker.GetFileCount() << endl;
 #endif
 
-        cout << "processing file " << szFilename << "...";
-        AbiFile abi( szFilename );
+        for ( size_t i = 0; i < worker.size(); ++i )
+        {
+            stats.Merge( worker[ i ].stats );
+        }
+    }
 
-        szFilename.resize( szFilename.length() - 4 );
-        szFilename.append( "_raw.csv" );
-        signal.clear();
-        abi.GetGSData( signal ); abi.GetCCDData( signal );
+    if ( opt.bStats )
+    {
+        double wall = ( AbiGetClock() - start ) / 1e9;
+
+        stats.Print( cout, wall );
 
-        if ( !WriteCSV( szFilename, signal ) )
+        if ( !opt.szStats.empty() && !stats.WriteJSON( opt.szStats, wall ) )
         {
-            cout << "file writing error" << endl;
+            cout << "cannot write " << opt.szStats << endl;
         }
+    }
 
-        szFilename = ( *i );
-        szFilename.resize( szFilename.length() - 4 );
-        szFilename.append( "_peak.csv" );
-        peak.clear();
-        abi.GetPeakData( peak );
-        WriteCSV( szFilename, peak );
+    if ( !( opt.nCompress == abiCOMPRESS_NONE ) && compressor.GetBytesIn() > 0 )
+    {
+        double wall = ( AbiGetClock() - start ) / 1e9;
+        char line[ 160 ];
+
+        snprintf( line, sizeof( line ), "compressed %.2f MB into %.2f MB (%.1f%%) at %.1f MB/s on %d thread(s), "
+            "%.1f MB/s per thread", compressor.GetBytesIn() / 1e6, compressor.GetBytesOut() / 1e6,
+            100.0 * compressor.GetBytesOut() / compressor.GetBytesIn(), compressor.GetBytesIn() / 1e6 / wall,
+            compressor.GetThreadCount(), ( compressor.GetTime() > 0 ) ?
+            compressor.GetBytesIn() * 1e3 / compressor.GetTime() : 0.0 );
+        cout << line << endl;
+    }
 
-        cout << " done" << endl;
-     }
+    if ( progress.GetFailed() > 0 )
+    {
+        cout << progress.GetFailed() << " file(s) failed to convert" << endl;
+    }
 
-    cout << "all tasks are completed!" << endl; return( 0 );
+    cout << "all tasks are completed!" << endl;
+    return( ( progress.GetFailed() > 0 ) ? 1 : 0 );
 }
@@ -0,0 +1,91 @@
+/*
+ * abiarena.cpp
+ *
+ * memory resource for the tables decoded from one tracefile
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <stdint.h>
+
+// C++ header files
+#include <algorithm>
+
+#include <abiarena.h>
+
+AbiArena::AbiArena(
+    size_t _size ) :
+    nBlock( 0 ), nOffset( 0 ), nUsed( 0 ), nCapacity( 0 ),
+    nBlockSize( ( _size > 0 ) ? _size : abiARENABLOCK )
+{
+}
+
+AbiArena::~AbiArena()
+{
+    for ( size_t i = 0; i < vBlock.size(); ++i )
+    {
+        delete [] vBlock[ i ].szData;
+    }
+}
+
+void AbiArena::AddBlock(
+    size_t _size )
+{
+    BLOCK block = { new char [ _size ], _size };
+
+    vBlock.push_back( block );
+    nCapacity += _size;
+}
+
+/*
+ * start over; a file that spilled into several blocks gets one block of the
+ * combined size from now on
+*/
+void AbiArena::Reset()
+{
+    if ( vBlock.size() > 1 )
+    {
+        size_t size = nCapacity;
+
+        for ( size_t i = 0; i < vBlock.size(); ++i )
+        {
+            delete [] vBlock[ i ].szData;
+        }
+
+        vBlock.clear(); nCapacity = 0;
+        AddBlock( size );
+        nBlockSize = size;
+    }
+
+    nBlock = 0; nOffset = 0; nUsed = 0;
+}
+
+void* AbiArena::do_allocate(
+    size_t _bytes, size_t _align )
+{
+    for ( ;; )
+    {
+        if ( nBlock < vBlock.size() )
+        {
+            // the address is aligned, not the offset, as a block need not be
+            uintptr_t address = reinterpret_cast<uintptr_t>( vBlock[ nBlock ].szData + nOffset );
+            size_t offset = nOffset + ( ( _align - ( address & ( _align - 1 ) ) ) & ( _align - 1 ) );
+
+            if ( !( offset > vBlock[ nBlock ].nSize ) && !( _bytes > vBlock[ nBlock ].nSize - offset ) )
+            {
+                nOffset = offset + _bytes; nUsed += _bytes;
+                return( vBlock[ nBlock ].szData + offset );
+            }
+
+            // the rest of this block is skipped until the next reset
+            if ( nBlock + 1 < vBlock.size() )
+            {
+                ++nBlock; nOffset = 0; continue;
+            }
+        }
+
+        // new[] aligns for any fundamental type; over-aligned requests get slack
+        AddBlock( max( nBlockSize, _bytes + _align ) );
+        nBlock = vBlock.size() - 1; nOffset = 0;
+    }
+}   // end of do_allocate()
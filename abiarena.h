@@ -0,0 +1,66 @@
+/*
+ * abiarena.h
+ *
+ * memory resource for the tables decoded from one tracefile
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_ARENA_H
+#define _ABI_ARENA_H
+
+#include <stddef.h>
+
+// C++ header files
+#include <vector>
+#include <memory_resource>
+
+using namespace std;
+
+const size_t abiARENABLOCK = 1 << 20;   // first block (bytes)
+
+/*
+ * hands out memory by bumping a pointer and never frees it one piece at a
+ * time; Reset drops everything at once but keeps the blocks for the next
+ * file. if a file needed more than one block, they are merged into one on
+ * Reset, so a batch soon runs without asking the heap for anything. the
+ * containers using the arena must be cleared before it is reset
+*/
+class AbiArena : public pmr::memory_resource
+{
+public:
+    explicit AbiArena( size_t = abiARENABLOCK );
+    ~AbiArena();
+
+    void Reset();
+
+    size_t GetUsed() const      { return( nUsed ); }
+    size_t GetCapacity() const  { return( nCapacity ); }
+    size_t GetBlockCount() const    { return( vBlock.size() ); }
+
+private:
+    struct BLOCK
+    {
+        char*   szData;
+        size_t  nSize;
+    };
+
+    vector<BLOCK>   vBlock;
+    size_t          nBlock;     // block being handed out
+    size_t          nOffset;    // first free byte in it
+    size_t          nUsed;      // bytes handed out since the last reset
+    size_t          nCapacity;  // bytes in all blocks
+    size_t          nBlockSize; // size of the next block
+
+    AbiArena( const AbiArena& );
+    AbiArena& operator=( const AbiArena& );
+
+    void    AddBlock( size_t );
+
+    void*   do_allocate( size_t, size_t ) override;
+    void    do_deallocate( void*, size_t, size_t ) override {}
+    bool    do_is_equal( const pmr::memory_resource& _r ) const noexcept override
+        { return( this == &_r ); }
+};
+
+#endif  // _ABI_ARENA_H
@@ -0,0 +1,712 @@
+/*
+ * abibench.cpp
+ *
+ * benchmarks for the tracefile library on synthetic tracefiles
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+
+// for standard c libraries
+#include <time.h>
+#include <unistd.h>
+
+#include <abitag.h>
+#include <abicsv.h>
+#include <abicompress.h>
+#include <abipool.h>
+#include <abicatalog.h>
+#include <abifile.h>
+#include <abilod.h>
+#include <abisynth.h>
+#include <abidecode.h>
+#include <abiseparate.h>
+
+// for c++ standard template library
+#include <list>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+/*
+ * one measurement; all of them are written to the results file
+*/
+struct RESULT
+{
+    string szBench;     // what was timed
+    string szCase;      // variant, e.g. the instruction set
+    long nSize;         // samples per channel or directory entries
+    double dValue;
+    string szUnit;
+};
+
+vector<RESULT> vResult;
+string szTempDir;
+volatile long nSink;
+
+/*
+ * wall clock in seconds
+*/
+double GetClock()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return( ts.tv_sec + ts.tv_nsec / 1e9 );
+}
+
+/*
+ * seconds per call; repeats until at least a tenth of a second has passed.
+ * the empty asm tells the compiler memory may have changed, so it can't
+ * hoist the work out of the loop
+*/
+template<class F> double Measure(
+    F _f )
+{
+    long round = 0;
+    double start = GetClock(), elapsed;
+
+    do {
+        _f(); ++round;
+        asm volatile( "" : : : "memory" );
+        elapsed = GetClock() - start;
+    } while ( elapsed < 0.1 || round < 3 );
+
+    return( elapsed / round );
+}
+
+void Record(
+    const string& _bench, const string& _case, long _size, double _value, const string& _unit )
+{
+    RESULT r = { _bench, _case, _size, _value, _unit };
+    vResult.push_back( r );
+
+    printf( "%-10s %-10s %8ld %12.3f %s\n", _bench.c_str(), _case.c_str(), _size, _value, _unit.c_str() );
+}
+
+/*
+ * results as a JSON array, one object per measurement
+*/
+bool WriteResult(
+    const string& _filename )
+{
+    FILE* file = fopen( _filename.c_str(), "w" );
+
+    if ( !file )
+    {
+        return( false );
+    }
+
+    fprintf( file, "[\n" );
+
+    for ( size_t i = 0; i < vResult.size(); ++i )
+    {
+        fprintf( file, "  {\"bench\": \"%s\", \"case\": \"%s\", \"size\": %ld, \"value\": %.6g, \"unit\": \"%s\"}%s\n",
+            vResult[ i ].szBench.c_str(), vResult[ i ].szCase.c_str(), vResult[ i ].nSize,
+            vResult[ i ].dValue, vResult[ i ].szUnit.c_str(), ( i + 1 < vResult.size() ) ? "," : "" );
+    }
+
+    fprintf( file, "]\n" );
+
+    return( fclose( file ) == 0 );
+}
+
+/*
+ * a synthetic tracefile in the temporary directory
+*/
+string MakeTrace(
+    int _samples, int _peaks, int _tags )
+{
+    ABISYNTH synth = abiSYNTHDEFAULT;
+    synth.nSamples = _samples; synth.nPeaks = _peaks; synth.nTags = _tags;
+
+    string file = szTempDir + "/abibench_" + to_string( _samples ) + "_" + to_string( _peaks ) +
+        "_" + to_string( _tags ) + ".ab1";
+
+    return( AbiWriteTrace( file, synth ) ? file : string() );
+}
+
+/*
+ * the lookup FindFlag() used to do: scan a list of records holding their
+ * flag names as strings and compare the names
+*/
+typedef list< pair<string, int> > FLAGLIST;
+
+FLAGLIST::iterator LinearFind(
+    FLAGLIST& _list, const string& _flag, const int _fid )
+{
+    FLAGLIST::iterator i;
+
+    for ( i = _list.begin(); !( i == _list.end() ); ++i )
+    {
+        if ( ( ( *i ).first == _flag ) && ( ( *i ).second == _fid ) )
+        {
+            return( i );
+        }
+    }
+
+    return( _list.end() );
+}
+
+/*
+ * the decode loop GetShort() used to run: shift, add and push_back
+*/
+void ScalarShort(
+    const unsigned char* _src, vector<int>& _v, int _count )
+{
+    int value;
+    _v.clear();
+
+    for ( int i = 0; i < _count; ++i )
+    {
+        value  = *_src++ << 0x8;
+        value += *_src++;
+        _v.push_back( value );
+    }
+}
+
+/*
+ * the writers abi2csv used before AbiCsvWriter: iostreams with endl per row
+*/
+bool StreamCSV(
+    string& _filename, pmr::list<SIGNAL>& _signal )
+{
+    ofstream csv( _filename.c_str(), ios::out | ios::trunc );
+    pmr::list<SIGNAL>::iterator filter = _signal.begin();
+
+    csv << "\"" << ( *filter ).szCaption.c_str() << "\"";
+
+    for ( ++filter; !( filter == _signal.end() ); ++filter )
+    {
+        csv << ",\"" << ( *filter ).szCaption.c_str() << "\"";
+    }
+
+    csv << endl;
+
+    for ( unsigned int i = 0; i < ( _signal.front() ).vSignal.size(); ++i )
+    {
+        filter = _signal.begin();
+        csv << static_cast<int>( ( *filter ).vSignal[ i ] );
+
+        for ( ++filter; !( filter == _signal.end() ); ++filter )
+        {
+            csv << "," << static_cast<int>( ( *filter ).vSignal[ i ] );
+        }
+
+        csv << endl;
+    }
+
+    csv.close(); return( true );
+}
+
+bool StreamCSV(
+    string& _filename, list<PEAK>& _peak )
+{
+    ofstream csv( _filename.c_str(), ios::out | ios::trunc );
+
+    for ( list<PEAK>::iterator peak = _peak.begin(); !( peak == _peak.end() ); ++peak )
+    {
+        csv << "\"" << ( *peak ).szCaption.c_str() << "\"" << endl;
+        csv << "\"Position\",\"Height\",\"BeginPeak\",\"EndPeak\",";
+        csv << "\"BeginHeight\",\"EndHeight\",\"Area\",\"Size\"" << endl;
+
+        for ( list<PEAKDATA>::iterator p = ( *peak ).lpPeak.begin(); !( p == ( *peak ).lpPeak.end() ); ++p )
+        {
+            csv << ( *p ).nPoint << "," << ( *p ).nHeight << ",";
+            csv << ( *p ).nBegin << "," << ( *p ).nEnd << ",";
+            csv << ( *p ).nBeginHi << "," << ( *p ).nEndHi << ",";
+            csv << ( *p ).nArea << "," << ( *p ).dSize << endl;
+        }
+    }
+
+    csv.close(); return( true );
+}
+
+double GetFileSize(
+    const string& _filename )
+{
+    struct stat fs;
+
+    return( stat( _filename.c_str(), &fs ) ? 0.0 : static_cast<double>( fs.st_size ) );
+}
+
+/*
+ * LoadFile, mapped and buffered
+*/
+void BenchLoad(
+    int _samples )
+{
+    string file = MakeTrace( _samples, 50, 256 );
+    double mb = GetFileSize( file ) / 1e6;
+    AbiFile abi;
+
+    double mapped = Measure( [ & ]() { abi.LoadFile( file.c_str(), abiMAPPED ); } );
+    double buffered = Measure( [ & ]() { abi.LoadFile( file.c_str(), abiBUFFERED ); } );
+
+    Record( "load", "mapped", _samples, mapped * 1e6, "us" );
+    Record( "load", "buffered", _samples, buffered * 1e6, "us" );
+    Record( "load", "buffered", _samples, mb / buffered, "MB/s" );
+
+    unlink( file.c_str() );
+}
+
+/*
+ * the lookups the export functions make for one file: DATA 1-12, PK_# 1-4
+ * and PEAK 1-4, plus one miss per channel; the old list scan against the
+ * index LoadFile builds
+*/
+void BenchFindFlag(
+    int _tags )
+{
+    string file = MakeTrace( 100, 1, _tags );
+    list<AbiTagRecord> record;
+    FLAGLIST tags;
+    AbiFile abi;
+    long found = 0;
+
+    abi.LoadFile( file.c_str() );
+    abi.GetTagRecord( record );
+
+    for ( list<AbiTagRecord>::iterator i = record.begin(); !( i == record.end() ); ++i )
+    {
+        tags.push_back( make_pair( ( *i ).GetFlagName(), ( *i ).GetFlagID() ) );
+    }
+
+    const AbiTagIndex& index = abi.GetTagRecord();
+
+    double linear = Measure( [ & ]()
+    {
+        for ( int i = 1; i < 13; ++i )
+        {
+            found += !( LinearFind( tags, "DATA", i ) == tags.end() );
+        }
+
+        for ( int i = 1; i < 5; ++i )
+        {
+            found += !( LinearFind( tags, "PK_#", i ) == tags.end() );
+            found += !( LinearFind( tags, "PEAK", i ) == tags.end() );
+            found += !( LinearFind( tags, "PEAK", i + 4 ) == tags.end() );
+        }
+    } );
+
+    double hashed = Measure( [ & ]()
+    {
+        for ( int i = 1; i < 13; ++i )
+        {
+            found += !( index.Find( abiFLAGDATA, i ) == NULL );
+        }
+
+        for ( int i = 1; i < 5; ++i )
+        {
+            found += !( index.Find( abiFLAGPKNUM, i ) == NULL );
+            found += !( index.Find( abiFLAGPEAK, i ) == NULL );
+            found += !( index.Find( abiFLAGPEAK, i + 4 ) == NULL );
+        }
+    } );
+
+    nSink = found;  // keep the lookups from being optimized away
+    Record( "findflag", "list", _tags, linear / 24 * 1e9, "ns" );
+    Record( "findflag", "index", _tags, hashed / 24 * 1e9, "ns" );
+
+    unlink( file.c_str() );
+}   // end of BenchFindFlag()
+
+/*
+ * one DATA channel with the old loop and every supported instruction set
+*/
+void BenchDecode(
+    int _count )
+{
+    vector<unsigned char> buffer( 4 * _count );
+    vector<int> data( _count ); vector<double> real( _count );
+    AbiDecodeTarget best = AbiGetDecodeTarget();
+
+    for ( size_t i = 0; i < buffer.size(); ++i )
+    {
+        buffer[ i ] = static_cast<unsigned char>( rand() );
+    }
+
+    Record( "short", "push_back", _count,
+        Measure( [ & ]() { ScalarShort( &buffer[ 0 ], data, _count ); } ) * 1e6, "us" );
+
+    for ( int t = abiDECODE_SCALAR; !( t > abiDECODE_AVX2 ); ++t )
+    {
+        if ( !AbiSetDecodeTarget( static_cast<AbiDecodeTarget>( t ) ) )
+        {
+            continue;
+        }
+
+        string name = AbiGetDecodeName( static_cast<AbiDecodeTarget>( t ) );
+
+        data.resize( _count );
+        Record( "short", name, _count,
+            Measure( [ & ]() { AbiDecodeShort( &buffer[ 0 ], &data[ 0 ], _count ); } ) * 1e6, "us" );
+        Record( "long", name, _count,
+            Measure( [ & ]() { AbiDecodeLong( &buffer[ 0 ], &data[ 0 ], _count ); } ) * 1e6, "us" );
+        Record( "float", name, _count,
+            Measure( [ & ]() { AbiDecodeFloat( &buffer[ 0 ], &real[ 0 ], _count ); } ) * 1e6, "us" );
+    }
+
+    AbiSetDecodeTarget( best );
+}   // end of BenchDecode()
+
+/*
+ * building the min/max pyramid of a channel, and drawing 1000 pixels of the
+ * whole channel from the samples and from the pyramid
+*/
+void BenchPyramid(
+    int _count )
+{
+    vector<int> data( _count ), lo( 1000 ), hi( 1000 );
+    AbiPyramid lod;
+
+    for ( int i = 0; i < _count; ++i )
+    {
+        data[ i ] = rand() & 0xFFFF;
+    }
+
+    Record( "lod", "build", _count, Measure( [ & ]()
+    {
+        lod.Build( &data[ 0 ], _count );
+    } ) * 1e6, "us" );
+
+    Record( "lod", "samples", _count, Measure( [ & ]()
+    {
+        for ( int c = 0; c < 1000; ++c )
+        {
+            int first = static_cast<int>( static_cast<long>( _count ) * c / 1000 );
+            int last = static_cast<int>( static_cast<long>( _count ) * ( c + 1 ) / 1000 );
+            lo[ c ] = *min_element( &data[ first ], &data[ 0 ] + last );
+            hi[ c ] = *max_element( &data[ first ], &data[ 0 ] + last );
+        }
+
+        nSink = lo[ 0 ];
+    } ) * 1e6, "us" );
+
+    Record( "lod", "query", _count, Measure( [ & ]()
+    {
+        nSink = lod.Query( &data[ 0 ], 0, _count, 1000, &lo[ 0 ], &hi[ 0 ] );
+    } ) * 1e6, "us" );
+}   // end of BenchPyramid()
+
+/*
+ * separating the four raw channels of a trace into dyes with every supported
+ * instruction set, then with the baseline removed first; the matrix is the
+ * one of the synthetic files
+*/
+void BenchSeparate(
+    int _count )
+{
+    vector<int> raw( 4 * _count ), dye( 4 * _count );
+    const int* src[ 4 ];
+    int* dst[ 4 ];
+    int matrix[ 16 ];
+    AbiDecodeTarget best = AbiGetDecodeTarget();
+    AbiSeparator separator;
+
+    for ( int i = 0; i < 16; ++i )
+    {
+        matrix[ i ] = ( i % 5 ) ? rand() % 500 : 10000;
+    }
+
+    for ( int f = 0; f < 4; ++f )
+    {
+        src[ f ] = &raw[ f * _count ]; dst[ f ] = &dye[ f * _count ];
+    }
+
+    for ( size_t i = 0; i < raw.size(); ++i )
+    {
+        raw[ i ] = rand() & 0xFFFF;
+    }
+
+    separator.SetMatrix( matrix, 16 );
+
+    for ( int t = abiDECODE_SCALAR; !( t > abiDECODE_AVX2 ); ++t )
+    {
+        if ( !AbiSetDecodeTarget( static_cast<AbiDecodeTarget>( t ) ) )
+        {
+            continue;
+        }
+
+        Record( "separate", AbiGetDecodeName( static_cast<AbiDecodeTarget>( t ) ), _count,
+            Measure( [ & ]() { separator.Separate( src, dst, _count ); } ) * 1e6, "us" );
+    }
+
+    AbiSetDecodeTarget( best );
+    separator.SetBaseline( 101 );
+
+    Record( "separate", "baseline", _count,
+        Measure( [ & ]() { separator.Separate( src, dst, _count ); } ) * 1e6, "us" );
+}   // end of BenchSeparate()
+
+/*
+ * metadata of a batch of files read from the files, in the lazy mode, and
+ * answered from a catalog saved by an earlier run
+*/
+void BenchCatalog(
+    int _files )
+{
+    string catalog = szTempDir + "/abibench.cat";
+    ABISYNTH synth = abiSYNTHDEFAULT;
+    vector<string> file;
+    ABICATALOGENTRY entry;
+    AbiFile abi;
+
+    for ( int i = 0; i < _files; ++i )
+    {
+        synth.nSeed = i + 1;
+        file.push_back( szTempDir + "/abibench_catalog_" + to_string( i ) + ".ab1" );
+        AbiWriteTrace( file.back(), synth );
+    }
+
+    unlink( catalog.c_str() );
+
+    Record( "catalog", "files", _files, Measure( [ & ]()
+    {
+        AbiCatalog cold;
+
+        for ( int i = 0; i < _files; ++i )
+        {
+            cold.Lookup( file[ i ], abi, entry );
+        }
+
+        cold.Save( catalog );
+    } ) / _files * 1e6, "us" );
+
+    AbiCatalog warm;
+
+    Record( "catalog", "load", _files, Measure( [ & ]()
+    {
+        warm.Load( catalog );
+    } ) / _files * 1e6, "us" );
+
+    Record( "catalog", "lookup", _files, Measure( [ & ]()
+    {
+        for ( int i = 0; i < _files; ++i )
+        {
+            warm.Lookup( file[ i ], abi, entry );
+        }
+    } ) / _files * 1e6, "us" );
+
+    for ( int i = 0; i < _files; ++i )
+    {
+        unlink( file[ i ].c_str() );
+    }
+
+    unlink( catalog.c_str() );
+}   // end of BenchCatalog()
+
+/*
+ * the export functions abi2csv calls on every file
+*/
+void BenchExport(
+    int _samples, int _peaks )
+{
+    string file = MakeTrace( _samples, _peaks, 256 );
+    pmr::list<SIGNAL> signal; list<PEAK> peak;
+    AbiFile abi;
+
+    abi.LoadFile( file.c_str() );
+
+    Record( "signal", "gs+ccd", _samples, Measure( [ & ]()
+    {
+        signal.clear(); abi.GetGSData( signal ); abi.GetCCDData( signal );
+    } ) * 1e6, "us" );
+
+    Record( "peak", "record", _peaks, Measure( [ & ]()
+    {
+        peak.clear(); abi.GetPeakData( peak );
+    } ) * 1e6, "us" );
+
+    vector<PEAKTABLE> table;
+
+    Record( "peak", "table", _peaks, Measure( [ & ]()
+    {
+        abi.GetPeakTable( table );
+    } ) * 1e6, "us" );
+
+    // the same tables one call at a time, and declared together in a plan
+    Record( "export", "calls", _samples, Measure( [ & ]()
+    {
+        signal.clear(); peak.clear();
+        abi.GetGSData( signal ); abi.GetCCDData( signal ); abi.GetPeakData( peak );
+    } ) * 1e6, "us" );
+
+    AbiPlan plan;
+
+    Record( "export", "plan", _samples, Measure( [ & ]()
+    {
+        signal.clear(); peak.clear(); plan.Clear();
+        abi.GetGSData( signal, plan ); abi.GetCCDData( signal, plan );
+        abi.GetPeakData( peak, plan ); abi.Extract( plan );
+    } ) * 1e6, "us" );
+
+    unlink( file.c_str() );
+}
+
+/*
+ * write the raw signal and peak tables of one trace, old writer against new
+*/
+void BenchCSV(
+    int _samples, int _peaks )
+{
+    string file = MakeTrace( _samples, _peaks, 256 );
+    string raw = szTempDir + "/abibench_raw.csv";
+    string pk = szTempDir + "/abibench_peak.csv";
+    pmr::list<SIGNAL> signal; list<PEAK> peak;
+    AbiCsvWriter writer;
+    AbiFile abi;
+
+    abi.LoadFile( file.c_str() );
+    abi.GetGSData( signal ); abi.GetCCDData( signal ); abi.GetPeakData( peak );
+
+    double elapsed[ 4 ] =
+    {
+        Measure( [ & ]() { StreamCSV( raw, signal ); } ),
+        Measure( [ & ]() { writer.WriteCSV( raw, signal ); } ),
+        Measure( [ & ]() { StreamCSV( pk, peak ); } ),
+        Measure( [ & ]() { writer.WriteCSV( pk, peak ); } )
+    };
+
+    double mb[ 2 ] = { GetFileSize( raw ) / 1e6, GetFileSize( pk ) / 1e6 };
+
+    Record( "csvraw", "ofstream", _samples, mb[ 0 ] / elapsed[ 0 ], "MB/s" );
+    Record( "csvraw", "writer", _samples, mb[ 0 ] / elapsed[ 1 ], "MB/s" );
+    Record( "csvpeak", "ofstream", 4 * _peaks, mb[ 1 ] / elapsed[ 2 ], "MB/s" );
+    Record( "csvpeak", "writer", 4 * _peaks, mb[ 1 ] / elapsed[ 3 ], "MB/s" );
+
+    unlink( raw.c_str() ); unlink( pk.c_str() ); unlink( file.c_str() );
+}   // end of BenchCSV()
+
+/*
+ * the raw signal table of one trace written plain and compressed, on one
+ * thread and on one per core; the value is the rate of the table as text
+*/
+void BenchCompress(
+    int _samples )
+{
+    string file = MakeTrace( _samples, _samples / 100, 256 );
+    string raw = szTempDir + "/abibench_raw.csv";
+    pmr::list<SIGNAL> signal;
+    AbiFile abi;
+
+    abi.LoadFile( file.c_str() );
+    abi.GetGSData( signal ); abi.GetCCDData( signal );
+
+    AbiCsvWriter plain;
+    double elapsed = Measure( [ & ]() { plain.WriteCSV( raw, signal ); } );
+    double mb = GetFileSize( raw ) / 1e6;
+
+    Record( "compress", "none", _samples, mb / elapsed, "MB/s" );
+
+    int level[] = { 1, 6 };
+    int threads[] = { 1, AbiWorkPool::GetDefaultSize() };
+
+    for ( int i = 0; i < 2; ++i )
+    {
+        for ( int k = 0; k < ( ( threads[ 1 ] > 1 ) ? 2 : 1 ); ++k )
+        {
+            AbiCompressor compressor( abiCOMPRESS_GZIP, level[ i ], threads[ k ] );
+            AbiCsvWriter writer( 1 << 16 );     // small blocks, so they overlap
+
+            writer.SetCompressor( &compressor );
+            elapsed = Measure( [ & ]() { writer.WriteCSV( raw, signal ); } );
+
+            string name = "gzip" + to_string( level[ i ] ) + "x" + to_string( threads[ k ] );
+            Record( "compress", name, _samples, mb / elapsed, "MB/s" );
+
+            if ( k == 0 )
+            {
+                Record( "ratio", "gzip" + to_string( level[ i ] ), _samples, GetFileSize( raw ) / 1e6 / mb, "" );
+            }
+        }
+    }
+
+    unlink( raw.c_str() ); unlink( file.c_str() );
+}   // end of BenchCompress()
+
+/*
+ * main procedure
+*/
+int main( int argc, char** argv )
+{
+    const char* tmp = getenv( "TMPDIR" );
+    string output;
+    int option;
+
+    szTempDir = tmp ? tmp : "/tmp";
+
+    while ( ( option = getopt( argc, argv, "o:" ) ) != -1 )
+    {
+        if ( option == 'o' )
+        {
+            output = optarg;
+        }
+        else
+        {
+            cout << "usage: " << argv[ 0 ] << " [-o results.json]" << endl;
+            cout << "time the tracefile library on synthetic tracefiles" << endl;
+            exit( 1 );
+        }
+    }
+
+    int samples[] = { 2000, 10000, 50000 };
+    int tags[] = { 64, 256, 1024 };
+
+    printf( "%-10s %-10s %8s %12s\n", "bench", "case", "size", "value" );
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        BenchLoad( samples[ i ] );
+    }
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        BenchFindFlag( tags[ i ] );
+    }
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        BenchDecode( samples[ i ] );
+    }
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        BenchPyramid( samples[ i ] );
+    }
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        BenchSeparate( samples[ i ] );
+    }
+
+    BenchCatalog( 200 );
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        BenchExport( samples[ i ], samples[ i ] / 100 );
+    }
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        BenchCSV( samples[ i ], samples[ i ] / 100 );
+    }
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        BenchCompress( samples[ i ] );
+    }
+
+    if ( !output.empty() && !WriteResult( output ) )
+    {
+        cout << "cannot write " << output << endl; return( 1 );
+    }
+
+    return( 0 );
+}
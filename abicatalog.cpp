@@ -0,0 +1,344 @@
+/*
+ * abicatalog.cpp
+ *
+ * tag directories and metadata of tracefiles kept from one run to the next
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <abifile.h>
+#include <abicatalog.h>
+
+// the directory is stored as the records are held in memory
+static_assert( is_trivially_copyable<AbiTagRecord>::value, "tag records are copied as bytes" );
+
+static const char abicMAGIC[ 8 ] = { 'A', 'B', 'I', 'C', 'A', 'T', 'L', 'G' };
+static const uint32_t abicVERSION = 1;     // also tells a foreign byte order
+
+/*
+ * the catalog file is read into memory and taken apart with these; every
+ * read checks that the bytes are there
+*/
+class CatalogReader
+{
+public:
+    CatalogReader( const string& _b ) : szBuffer( _b.data() ), nSize( _b.size() ), nOffset( 0 ) {}
+
+    bool Get( void* _p, size_t _n )
+    {
+        if ( _n > nSize - nOffset )
+        {
+            return( false );
+        }
+
+        memcpy( _p, szBuffer + nOffset, _n ); nOffset += _n;
+        return( true );
+    }
+
+    bool Get( string& _s )
+    {
+        uint32_t n;
+
+        if ( !Get( &n, sizeof( n ) ) || n > nSize - nOffset )
+        {
+            return( false );
+        }
+
+        _s.assign( szBuffer + nOffset, n ); nOffset += n;
+        return( true );
+    }
+
+    bool IsEnd() const  { return( nOffset == nSize ); }
+
+private:
+    const char* szBuffer;
+    size_t nSize;
+    size_t nOffset;
+};
+
+static void PutBytes(
+    string& _b, const void* _p, size_t _n )
+{
+    _b.append( static_cast<const char*>( _p ), _n );
+}
+
+static void PutString(
+    string& _b, const string& _s )
+{
+    uint32_t n = _s.size();
+    PutBytes( _b, &n, sizeof( n ) ); _b.append( _s );
+}
+
+const ABICATALOGTAG* ABICATALOGENTRY::FindTag(
+    const unsigned int _code, const int _fid ) const
+{
+    for ( size_t i = 0; i < vTag.size(); ++i )
+    {
+        if ( vTag[ i ].nFlagCode == _code && vTag[ i ].nFlagID == _fid )
+        {
+            return( &vTag[ i ] );
+        }
+    }
+
+    return( NULL );
+}
+
+AbiCatalog::AbiCatalog() :
+    bChanged( false ), nHit( 0 ), nMiss( 0 )
+{
+    AddTag( ABI_FLAG( 'S', 'p', 'N', 'm' ), 1 );   // sample name
+    AddTag( ABI_FLAG( 'L', 'A', 'N', 'E' ), 1 );   // lane or capillary
+    AddTag( ABI_FLAG( 'R', 'U', 'N', 'T' ), 1 );   // run start time
+    AddTag( ABI_FLAG( 'D', 'y', 'S', 'N' ), 1 );   // dye set name
+    AddTag( ABI_FLAG( 'U', 's', 'e', 'r' ), 1 );   // user name
+}
+
+/*
+ * read the catalog file; a missing file is an empty catalog. false if the
+ * file is damaged or was written elsewhere, in which case the catalog is
+ * empty too and will be rebuilt as the files are looked up
+*/
+bool AbiCatalog::Load(
+    const string& _file )
+{
+    ifstream in( _file.c_str(), ios::in | ios::binary );
+    lock_guard<mutex> lock( mLock );
+
+    mpEntry.clear(); bChanged = false;
+
+    if ( !in )
+    {
+        return( true );
+    }
+
+    string buffer;
+
+    in.seekg( 0, ios::end ); buffer.resize( in.tellg() );
+    in.seekg( 0, ios::beg ); in.read( &buffer[ 0 ], buffer.size() );
+    CatalogReader reader( buffer );
+    char magic[ sizeof( abicMAGIC ) ];
+    uint32_t version, record;
+    uint64_t count;
+
+    bool ok = reader.Get( magic, sizeof( magic ) ) && !memcmp( magic, abicMAGIC, sizeof( magic ) ) &&
+        reader.Get( &version, sizeof( version ) ) && version == abicVERSION &&
+        reader.Get( &record, sizeof( record ) ) && record == sizeof( AbiTagRecord ) &&
+        reader.Get( &count, sizeof( count ) );
+
+    for ( uint64_t i = 0; ok && i < count; ++i )
+    {
+        ABICATALOGENTRY entry;
+        uint32_t n;
+
+        ok = reader.Get( entry.szPath ) && reader.Get( &entry.nSize, sizeof( entry.nSize ) ) &&
+            reader.Get( &entry.nModified, sizeof( entry.nModified ) ) && reader.Get( &n, sizeof( n ) ) &&
+            !( n > buffer.size() / sizeof( AbiTagRecord ) );
+
+        if ( ok )
+        {
+            entry.vDirectory.resize( n );
+            ok = reader.Get( entry.vDirectory.data(), n * sizeof( AbiTagRecord ) ) &&
+                reader.Get( &n, sizeof( n ) ) && !( n > buffer.size() );
+        }
+
+        for ( uint32_t k = 0; ok && k < n; ++k )
+        {
+            ABICATALOGTAG tag;
+            uint8_t found = 0;
+
+            ok = reader.Get( &tag.nFlagCode, sizeof( tag.nFlagCode ) ) &&
+                reader.Get( &tag.nFlagID, sizeof( tag.nFlagID ) ) &&
+                reader.Get( &found, sizeof( found ) ) && reader.Get( tag.szValue );
+            tag.bFound = found;
+            entry.vTag.push_back( tag );
+        }
+
+        if ( ok )
+        {
+            mpEntry[ entry.szPath ] = move( entry );
+        }
+    }
+
+    if ( !ok || !reader.IsEnd() )
+    {
+        mpEntry.clear(); return( false );
+    }
+
+    return( true );
+}   // end of Load()
+
+/*
+ * write the catalog if anything changed since it was loaded; a reader never
+ * sees a half written catalog
+*/
+bool AbiCatalog::Save(
+    const string& _file )
+{
+    lock_guard<mutex> lock( mLock );
+
+    if ( !bChanged )
+    {
+        return( true );
+    }
+
+    string buffer, temp = _file + ".tmp";
+    uint32_t version = abicVERSION, record = sizeof( AbiTagRecord );
+    uint64_t count = mpEntry.size();
+
+    PutBytes( buffer, abicMAGIC, sizeof( abicMAGIC ) );
+    PutBytes( buffer, &version, sizeof( version ) );
+    PutBytes( buffer, &record, sizeof( record ) );
+    PutBytes( buffer, &count, sizeof( count ) );
+
+    for ( ENTRYMAP::const_iterator i = mpEntry.begin(); !( i == mpEntry.end() ); ++i )
+    {
+        const ABICATALOGENTRY& entry = ( *i ).second;
+        uint32_t n = entry.vDirectory.size();
+
+        PutString( buffer, entry.szPath );
+        PutBytes( buffer, &entry.nSize, sizeof( entry.nSize ) );
+        PutBytes( buffer, &entry.nModified, sizeof( entry.nModified ) );
+        PutBytes( buffer, &n, sizeof( n ) );
+        PutBytes( buffer, entry.vDirectory.data(), n * sizeof( AbiTagRecord ) );
+
+        n = entry.vTag.size();
+        PutBytes( buffer, &n, sizeof( n ) );
+
+        for ( size_t k = 0; k < entry.vTag.size(); ++k )
+        {
+            uint8_t found = entry.vTag[ k ].bFound;
+
+            PutBytes( buffer, &entry.vTag[ k ].nFlagCode, sizeof( entry.vTag[ k ].nFlagCode ) );
+            PutBytes( buffer, &entry.vTag[ k ].nFlagID, sizeof( entry.vTag[ k ].nFlagID ) );
+            PutBytes( buffer, &found, sizeof( found ) );
+            PutString( buffer, entry.vTag[ k ].szValue );
+        }
+    }
+
+    FILE* file = fopen( temp.c_str(), "wb" );
+
+    if ( !file )
+    {
+        return( false );
+    }
+
+    bool ok = ( fwrite( buffer.data(), 1, buffer.size(), file ) == buffer.size() );
+    ok = !fflush( file ) && !fsync( fileno( file ) ) && ok;
+    ok = !fclose( file ) && ok;
+
+    if ( !ok || rename( temp.c_str(), _file.c_str() ) )
+    {
+        unlink( temp.c_str() ); return( false );
+    }
+
+    bChanged = false;
+
+    return( true );
+}   // end of Save()
+
+/*
+ * the entry matches the file on disk and holds every catalog tag
+*/
+bool AbiCatalog::IsCurrent(
+    const ABICATALOGENTRY& _entry, uint64_t _size, int64_t _modified ) const
+{
+    if ( !( _entry.nSize == _size ) || !( _entry.nModified == _modified ) )
+    {
+        return( false );
+    }
+
+    for ( size_t i = 0; i < vTag.size(); ++i )
+    {
+        if ( !_entry.FindTag( vTag[ i ].first, vTag[ i ].second ) )
+        {
+            return( false );
+        }
+    }
+
+    return( true );
+}
+
+/*
+ * the directory and the catalog tags of a file; the tags are declared in a
+ * plan so their payloads are fetched together
+*/
+bool AbiCatalog::ReadEntry(
+    const string& _file, uint64_t _size, int64_t _modified, AbiFile& _abi, ABICATALOGENTRY& _entry )
+{
+    AbiPlan plan;
+
+    if ( !_abi.LoadFile( _file.c_str(), abiLAZY ) )
+    {
+        return( false );
+    }
+
+    _entry.szPath = _file; _entry.nSize = _size; _entry.nModified = _modified;
+    _entry.vDirectory = _abi.GetTagRecord().GetRecord();
+    _entry.vTag.resize( vTag.size() );
+
+    for ( size_t i = 0; i < vTag.size(); ++i )
+    {
+        _entry.vTag[ i ].nFlagCode = vTag[ i ].first;
+        _entry.vTag[ i ].nFlagID = vTag[ i ].second;
+        _entry.vTag[ i ].szValue.clear();
+        plan.AddText( vTag[ i ].first, vTag[ i ].second, _entry.vTag[ i ].szValue );
+    }
+
+    _abi.Extract( plan );
+
+    for ( size_t i = 0; i < vTag.size(); ++i )
+    {
+        _entry.vTag[ i ].bFound = plan.IsFound( i );
+    }
+
+    return( true );
+}
+
+/*
+ * the entry of a file, from the catalog if it is still good and from the file
+ * otherwise; the file is read with _abi. false if the file cannot be read
+*/
+bool AbiCatalog::Lookup(
+    const string& _file, AbiFile& _abi, ABICATALOGENTRY& _entry )
+{
+    struct stat fs;
+
+    if ( stat( _file.c_str(), &fs ) )
+    {
+        return( false );
+    }
+
+    uint64_t size = fs.st_size;
+    int64_t modified = static_cast<int64_t>( fs.st_mtim.tv_sec ) * 1000000000 + fs.st_mtim.tv_nsec;
+
+    {
+        lock_guard<mutex> lock( mLock );
+        ENTRYMAP::const_iterator i = mpEntry.find( _file );
+
+        if ( !( i == mpEntry.end() ) && IsCurrent( ( *i ).second, size, modified ) )
+        {
+            _entry = ( *i ).second; ++nHit;
+            return( true );
+        }
+    }
+
+    // the file is read without holding the lock
+    if ( !ReadEntry( _file, size, modified, _abi, _entry ) )
+    {
+        return( false );
+    }
+
+    lock_guard<mutex> lock( mLock );
+
+    mpEntry[ _file ] = _entry; bChanged = true; ++nMiss;
+
+    return( true );
+}   // end of Lookup()
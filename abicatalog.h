@@ -0,0 +1,95 @@
+/*
+ * abicatalog.h
+ *
+ * tag directories and metadata of tracefiles kept from one run to the next
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_CATALOG_H
+#define _ABI_CATALOG_H
+
+#include <stdint.h>
+
+// C++ header files
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+#include <abitag.h>
+
+using namespace std;
+
+class AbiFile;
+
+/*
+ * a tag in readable form, see AbiFile::GetText; a tag the file does not have
+ * is kept as well, so the file is not read again just to find that out
+*/
+struct ABICATALOGTAG
+{
+    unsigned int nFlagCode;
+    int nFlagID;
+    bool bFound;
+    string szValue;
+};
+
+/*
+ * what the catalog knows about one tracefile; good for as long as the size
+ * and the modification time of the file stay the same
+*/
+struct ABICATALOGENTRY
+{
+    string szPath;
+    uint64_t nSize;                     // bytes
+    int64_t nModified;                  // modification time (ns since the epoch)
+    vector<AbiTagRecord> vDirectory;    // in file order
+    vector<ABICATALOGTAG> vTag;
+
+    const ABICATALOGTAG* FindTag( const unsigned int, const int ) const;
+};
+
+/*
+ * answers for a tracefile from its entry without opening the file; only a
+ * stat is needed to tell that the entry is still good. new and changed files
+ * are read in the lazy mode, header, directory and the catalog tags only, and
+ * their entries replaced. the entries are kept in one file in the byte order
+ * of the machine; Save writes it only if something changed, to a temporary
+ * file renamed over the old one. Lookup may be called by several workers
+*/
+class AbiCatalog
+{
+public:
+    AbiCatalog();
+
+    bool Load( const string& );
+    bool Save( const string& );
+
+    // the tags every entry holds; SpNm, LANE, RUNT, DySN and User by default
+    void ClearTags()    { vTag.clear(); }
+    void AddTag( const unsigned int _code, const int _fid )
+        { vTag.push_back( make_pair( _code, _fid ) ); }
+
+    bool Lookup( const string&, AbiFile&, ABICATALOGENTRY& );
+
+    size_t GetCount() const     { return( mpEntry.size() ); }
+    size_t GetHitCount() const  { return( nHit ); }
+    size_t GetMissCount() const { return( nMiss ); }
+
+private:
+    typedef unordered_map<string, ABICATALOGENTRY> ENTRYMAP;
+
+    mutex       mLock;
+    ENTRYMAP    mpEntry;            // by path, as given to Lookup
+    vector< pair<unsigned int, int> > vTag;
+    bool        bChanged;           // entries added or replaced since Load
+    size_t      nHit;               // lookups answered from the catalog
+    size_t      nMiss;              // lookups that read the file
+
+    bool    IsCurrent( const ABICATALOGENTRY&, uint64_t, int64_t ) const;
+    bool    ReadEntry( const string&, uint64_t, int64_t, AbiFile&, ABICATALOGENTRY& );
+};
+
+#endif  // _ABI_CATALOG_H
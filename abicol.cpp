@@ -0,0 +1,464 @@
+/*
+ * abicol.cpp
+ *
+ * columnar binary export of the signal and peak tables
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <abitag.h>
+#include <abifile.h>
+#include <abicol.h>
+#include <abilod.h>
+#include <abistats.h>
+
+static_assert( sizeof( ABICOLHEADER ) == 64, "column file header must be 64 bytes" );
+static_assert( sizeof( ABICOLUMN ) == 72, "column directory entry must be 72 bytes" );
+
+/*
+ * copy a caption into a fixed width, zero padded field
+*/
+static void SetName(
+    char* _dst, size_t _size, const char* _src )
+{
+    size_t length = strlen( _src );
+
+    memset( _dst, 0, _size );
+    memcpy( _dst, _src, ( length < _size ) ? length : _size - 1 );
+}
+
+static size_t Align(
+    size_t _n )
+{
+    return( ( _n + colALIGN - 1 ) & ~( colALIGN - 1 ) );
+}
+
+/*
+ * the width the readers of a column type rely on; text may have any width,
+ * an unknown type none
+*/
+static bool IsWidthValid(
+    uint32_t _type, uint32_t _width )
+{
+    switch ( _type )
+    {
+    case abiCOL_INT16:      return( _width == sizeof( int16_t ) );
+    case abiCOL_INT32:      return( _width == sizeof( int32_t ) );
+    case abiCOL_FLOAT32:    return( _width == sizeof( float ) );
+    case abiCOL_UINT8:      return( _width == sizeof( uint8_t ) );
+    case abiCOL_CHAR:       return( _width > 0 );
+    default:                return( false );
+    }
+}
+
+void AbiColumnWriter::AddColumn(
+    const string& _table, const char* _name, AbiColumnType _type, uint32_t _width,
+    const void* _data, size_t _count )
+{
+    ABICOLUMN column;
+
+    SetName( column.szTable, sizeof( column.szTable ), _table.c_str() );
+    SetName( column.szName, sizeof( column.szName ), _name );
+    column.nType = _type; column.nWidth = _width;
+    column.nOffset = Align( vData.size() ); column.nCount = _count;
+
+    vData.resize( column.nOffset + _count * _width );
+
+    if ( _data && _count > 0 )
+    {
+        memcpy( &vData[ column.nOffset ], _data, _count * _width );
+    }
+
+    vColumn.push_back( column );
+}
+
+string AbiColumnWriter::GetSignalName(
+    const SIGNAL& _signal )
+{
+    return( ( _signal.nFlagID > 0 ) ? "DATA " + to_string( _signal.nFlagID ) :
+        string( _signal.szCaption.c_str() ) );
+}
+
+/*
+ * one int16 column per signal; the samples are the 16-bit words of the DATA
+ * tags, so values above 32767 come back negative as in the ABIF spec
+*/
+void AbiColumnWriter::AddSignal(
+    pmr::list<SIGNAL>& _signal )
+{
+    for ( pmr::list<SIGNAL>::iterator i = _signal.begin(); !( i == _signal.end() ); ++i )
+    {
+        // a computed signal may leave the range of the channels it came from
+        if ( ( *i ).nFlagID > 0 )
+        {
+            vShort.assign( ( *i ).vSignal.begin(), ( *i ).vSignal.end() );
+            AddColumn( "signal", GetSignalName( *i ).c_str(), abiCOL_INT16, sizeof( int16_t ),
+                vShort.data(), vShort.size() );
+        }
+        else
+        {
+            vLong.assign( ( *i ).vSignal.begin(), ( *i ).vSignal.end() );
+            AddColumn( "signal", GetSignalName( *i ).c_str(), abiCOL_INT32, sizeof( int32_t ),
+                vLong.data(), vLong.size() );
+        }
+    }
+}
+
+/*
+ * the peak records of every filter as a table of typed columns
+*/
+void AbiColumnWriter::AddPeak(
+    list<PEAK>& _peak )
+{
+    const char* szNAME[] = { "Position", "Height", "BeginPeak", "EndPeak",
+        "BeginHeight", "EndHeight", "Area", "Volume" };
+
+    for ( list<PEAK>::iterator i = _peak.begin(); !( i == _peak.end() ); ++i )
+    {
+        list<PEAKDATA>& lp = ( *i ).lpPeak;
+        size_t count = lp.size();
+        list<PEAKDATA>::iterator p;
+
+        for ( int k = 0; k < 8; ++k )
+        {
+            vLong.clear();
+
+            for ( p = lp.begin(); !( p == lp.end() ); ++p )
+            {
+                const int value[] = { ( *p ).nPoint, ( *p ).nHeight, ( *p ).nBegin, ( *p ).nEnd,
+                    ( *p ).nBeginHi, ( *p ).nEndHi, ( *p ).nArea, ( *p ).nVolume };
+                vLong.push_back( value[ k ] );
+            }
+
+            AddColumn( ( *i ).szCaption, szNAME[ k ], abiCOL_INT32, sizeof( int32_t ), vLong.data(), count );
+        }
+
+        vFloat.clear(); vShort.clear();
+
+        for ( p = lp.begin(); !( p == lp.end() ); ++p )
+        {
+            vFloat.push_back( static_cast<float>( ( *p ).dSize ) );
+            vShort.push_back( ( *p ).bEdit );
+        }
+
+        AddColumn( ( *i ).szCaption, "Size", abiCOL_FLOAT32, sizeof( float ), vFloat.data(), count );
+
+        // the edit flags and labels are built in place
+        AddColumn( ( *i ).szCaption, "Edit", abiCOL_UINT8, 1, NULL, count );
+        char* dst = &vData[ 0 ] + vColumn.back().nOffset;
+
+        for ( size_t k = 0; k < count; ++k )
+        {
+            dst[ k ] = static_cast<char>( vShort[ k ] );
+        }
+
+        AddColumn( ( *i ).szCaption, "Label", abiCOL_CHAR, 64, NULL, count );
+        dst = &vData[ 0 ] + vColumn.back().nOffset;
+
+        for ( p = lp.begin(); !( p == lp.end() ); ++p, dst += 64 )
+        {
+            SetName( dst, 64, ( *p ).szLabel.c_str() );
+        }
+    }
+}   // end of AddPeak()
+
+/*
+ * a peak table is already in columns; only the labels are copied as they are
+*/
+void AbiColumnWriter::AddPeak(
+    vector<PEAKTABLE>& _peak )
+{
+    for ( vector<PEAKTABLE>::iterator t = _peak.begin(); !( t == _peak.end() ); ++t )
+    {
+        const string& table = ( *t ).szCaption;
+        size_t count = ( *t ).nCount;
+
+        AddColumn( table, "Position", abiCOL_INT32, sizeof( int32_t ), ( *t ).vPosition.data(), count );
+        AddColumn( table, "Height", abiCOL_INT32, sizeof( int32_t ), ( *t ).vHeight.data(), count );
+        AddColumn( table, "BeginPeak", abiCOL_INT32, sizeof( int32_t ), ( *t ).vBegin.data(), count );
+        AddColumn( table, "EndPeak", abiCOL_INT32, sizeof( int32_t ), ( *t ).vEnd.data(), count );
+        AddColumn( table, "BeginHeight", abiCOL_INT32, sizeof( int32_t ), ( *t ).vBeginHi.data(), count );
+        AddColumn( table, "EndHeight", abiCOL_INT32, sizeof( int32_t ), ( *t ).vEndHi.data(), count );
+        AddColumn( table, "Area", abiCOL_INT32, sizeof( int32_t ), ( *t ).vArea.data(), count );
+        AddColumn( table, "Volume", abiCOL_INT32, sizeof( int32_t ), ( *t ).vVolume.data(), count );
+        AddColumn( table, "Size", abiCOL_FLOAT32, sizeof( float ), ( *t ).vSize.data(), count );
+        AddColumn( table, "Edit", abiCOL_UINT8, 1, ( *t ).vEdit.data(), count );
+        AddColumn( table, "Label", abiCOL_CHAR, abifLABELSIZE, ( *t ).vLabel.data(), count );
+    }
+}   // end of AddPeak()
+
+/*
+ * two int32 columns per level, "min <step>" and "max <step>", where step is
+ * the number of samples per bucket
+*/
+void AbiColumnWriter::AddPyramid(
+    const string& _table, const AbiPyramid& _lod )
+{
+    char name[ 24 ];
+
+    for ( int l = 0; l < _lod.GetLevelCount(); ++l )
+    {
+        snprintf( name, sizeof( name ), "min %zu", _lod.GetStep( l ) );
+        AddColumn( _table, name, abiCOL_INT32, sizeof( int32_t ), _lod.GetMin( l ), _lod.GetSize( l ) );
+        snprintf( name, sizeof( name ), "max %zu", _lod.GetStep( l ) );
+        AddColumn( _table, name, abiCOL_INT32, sizeof( int32_t ), _lod.GetMax( l ), _lod.GetSize( l ) );
+    }
+}
+
+uint64_t AbiColumnWriter::GetFileSize() const
+{
+    return( Align( sizeof( ABICOLHEADER ) + vColumn.size() * sizeof( ABICOLUMN ) ) + vData.size() );
+}
+
+bool AbiColumnWriter::Write(
+    const string& _filename )
+{
+    int fd = open( _filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+
+    if ( fd < 0 )
+    {
+        return( false );
+    }
+
+    bool ok = Write( fd, 0 );
+
+    return( !close( fd ) && ok );
+}
+
+/*
+ * header, directory and the column data in one pwritev at _offset; the
+ * offsets in the file are from the start of the header, so an image written
+ * into a larger file reads back the same once it is mapped on its own
+*/
+bool AbiColumnWriter::Write(
+    int _fd, uint64_t _offset )
+{
+    AbiTimer timer( pStats, abiSTAGE_COLUMN );
+    ABICOLHEADER header;
+    size_t directory = vColumn.size() * sizeof( ABICOLUMN );
+    size_t base = Align( sizeof( header ) + directory );
+
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.szMagic, colMAGIC, sizeof( colMAGIC ) );
+    header.nVersion = colVERSION; header.nByteOrder = colBYTEORDER;
+    header.nColumns = vColumn.size();
+    header.nDirectory = sizeof( header );
+    header.nFileSize = base + vData.size();
+
+    for ( size_t i = 0; i < vColumn.size(); ++i )
+    {
+        vColumn[ i ].nOffset += base;
+    }
+
+    char padding[ colALIGN ] = { 0 };
+    struct iovec part[ 4 ] =
+    {
+        { &header, sizeof( header ) },
+        { vColumn.data(), directory },
+        { padding, base - sizeof( header ) - directory },
+        { vData.data(), vData.size() }
+    };
+
+    size_t total = header.nFileSize, written = 0;
+    int first = 0;
+
+    while ( written < total )
+    {
+        ssize_t n = pwritev( _fd, part + first, 4 - first, _offset + written );
+
+        if ( n < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if ( n < 0 )
+        {
+            break;
+        }
+
+        written += n;
+
+        for ( ; first < 4 && static_cast<size_t>( n ) >= part[ first ].iov_len; ++first )
+        {
+            n -= part[ first ].iov_len;
+        }   // skip the parts that went out completely
+
+        if ( first < 4 )
+        {
+            part[ first ].iov_base = static_cast<char*>( part[ first ].iov_base ) + n;
+            part[ first ].iov_len -= n;
+        }
+    }
+
+    for ( size_t i = 0; i < vColumn.size(); ++i )
+    {
+        vColumn[ i ].nOffset -= base;
+    }
+
+    timer.Set( written, vColumn.size() );
+
+    return( written == total );
+}   // end of Write()
+
+/*
+ * map the file and check that the header and every column are in bounds
+*/
+bool AbiColumnFile::Open(
+    const char* _filename )
+{
+    struct stat fs;
+
+    Close();
+
+    int fd = open( _filename, O_RDONLY );
+
+    if ( fd < 0 )
+    {
+        return( false );
+    }
+
+    if ( fstat( fd, &fs ) || fs.st_size < static_cast<off_t>( sizeof( ABICOLHEADER ) ) )
+    {
+        close( fd ); return( false );
+    }
+
+    void* p = mmap( NULL, fs.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+
+    if ( p == MAP_FAILED )
+    {
+        return( false );
+    }
+
+    if ( !Open( p, fs.st_size ) )
+    {
+        munmap( p, fs.st_size ); return( false );
+    }
+
+    bMapped = true;
+
+    return( true );
+}   // end of Open()
+
+/*
+ * check the header and every column of an image that stays owned by the
+ * caller; it has to start on a 64 byte boundary for the columns to align.
+ * the bounds are checked by subtraction, so no offset or count in the file
+ * can wrap them around
+*/
+bool AbiColumnFile::Open(
+    const void* _data, size_t _size )
+{
+    Close();
+
+    if ( _size < sizeof( ABICOLHEADER ) || ( reinterpret_cast<uintptr_t>( _data ) % colALIGN ) )
+    {
+        return( false );
+    }
+
+    szBuffer = static_cast<const unsigned char*>( _data ); nSize = _size;
+    pHeader = reinterpret_cast<const ABICOLHEADER*>( szBuffer );
+
+    bool valid = !memcmp( pHeader->szMagic, colMAGIC, sizeof( colMAGIC ) ) &&
+        pHeader->nVersion == colVERSION && pHeader->nByteOrder == colBYTEORDER &&
+        pHeader->nFileSize == nSize && !( pHeader->nDirectory % sizeof( uint64_t ) ) &&
+        !( pHeader->nDirectory > nSize ) &&
+        !( pHeader->nColumns > ( nSize - pHeader->nDirectory ) / sizeof( ABICOLUMN ) );
+
+    if ( valid )
+    {
+        pColumn = reinterpret_cast<const ABICOLUMN*>( szBuffer + pHeader->nDirectory );
+
+        for ( uint32_t i = 0; valid && i < pHeader->nColumns; ++i )
+        {
+            const ABICOLUMN& c = pColumn[ i ];
+            valid = IsWidthValid( c.nType, c.nWidth ) && !( c.nOffset % colALIGN ) && !( c.nOffset > nSize ) &&
+                !( c.nCount > ( nSize - c.nOffset ) / c.nWidth );
+        }
+    }
+
+    if ( !valid )
+    {
+        szBuffer = NULL; nSize = 0; pHeader = NULL; pColumn = NULL;
+    }
+
+    return( valid );
+}   // end of Open()
+
+void AbiColumnFile::Close()
+{
+    if ( szBuffer && bMapped )
+    {
+        munmap( const_cast<unsigned char*>( szBuffer ), nSize );
+    }
+
+    szBuffer = NULL; nSize = 0; pHeader = NULL; pColumn = NULL; bMapped = false;
+}
+
+/*
+ * index of the next column in _table called _name, starting at _start; -1
+ * if there is none. pass the last hit plus one to walk through columns of
+ * the same name
+*/
+int AbiColumnFile::FindColumn(
+    const char* _table, const char* _name, int _start ) const
+{
+    for ( int i = _start; i < GetColumnCount(); ++i )
+    {
+        if ( !strncmp( pColumn[ i ].szTable, _table, sizeof( pColumn[ i ].szTable ) ) &&
+            !strncmp( pColumn[ i ].szName, _name, sizeof( pColumn[ i ].szName ) ) )
+        {
+            return( i );
+        }
+    }
+
+    return( -1 );
+}
+
+const void* AbiColumnFile::GetData(
+    int _i, AbiColumnType _type ) const
+{
+    if ( _i < 0 || !( _i < GetColumnCount() ) || !( pColumn[ _i ].nType == static_cast<uint32_t>( _type ) ) )
+    {
+        return( NULL );
+    }
+
+    return( szBuffer + pColumn[ _i ].nOffset );
+}
+
+const int16_t* AbiColumnFile::GetShort(
+    int _i ) const
+{
+    return( static_cast<const int16_t*>( GetData( _i, abiCOL_INT16 ) ) );
+}
+
+const int32_t* AbiColumnFile::GetLong(
+    int _i ) const
+{
+    return( static_cast<const int32_t*>( GetData( _i, abiCOL_INT32 ) ) );
+}
+
+const float* AbiColumnFile::GetFloat(
+    int _i ) const
+{
+    return( static_cast<const float*>( GetData( _i, abiCOL_FLOAT32 ) ) );
+}
+
+const uint8_t* AbiColumnFile::GetByte(
+    int _i ) const
+{
+    return( static_cast<const uint8_t*>( GetData( _i, abiCOL_UINT8 ) ) );
+}
+
+const char* AbiColumnFile::GetChar(
+    int _i ) const
+{
+    return( static_cast<const char*>( GetData( _i, abiCOL_CHAR ) ) );
+}
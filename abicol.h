@@ -0,0 +1,151 @@
+/*
+ * abicol.h
+ *
+ * columnar binary export of the signal and peak tables
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_COL_H
+#define _ABI_COL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C++ header files
+#include <list>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct SIGNAL;
+struct PEAK;
+struct PEAKTABLE;
+class AbiPyramid;
+class AbiStats;
+
+/*
+ * file layout, all integers in the byte order of the machine that wrote it:
+ *
+ *  header      64 bytes, ABICOLHEADER
+ *  directory   one ABICOLUMN per column
+ *  columns     each one starts on a 64 byte boundary
+ *
+ * signals are stored in table "signal", in the order they were added. the
+ * channels read from the file are int16 columns, each named after its tag,
+ * e.g. "DATA 9" for the first analyzed and "DATA 1" for the first raw
+ * channel, so the same caption of the two can be told apart; a signal
+ * computed from them, such as a separated dye, is an int32 column under its
+ * caption, since it need not fit the range of the channels. every peak
+ * filter is its own table named after its caption
+*/
+const char colMAGIC[ 8 ] = { 'A', 'B', 'I', 'F', 'C', 'O', 'L', 0 };
+const uint32_t colVERSION   = 1;
+const uint32_t colBYTEORDER = 0x01020304;
+const size_t colALIGN       = 64;
+
+enum AbiColumnType
+{
+    abiCOL_INT16    = 1,
+    abiCOL_INT32    = 2,
+    abiCOL_FLOAT32  = 3,
+    abiCOL_UINT8    = 4,
+    abiCOL_CHAR     = 5     // fixed width, zero padded text
+};
+
+struct ABICOLHEADER
+{
+    char        szMagic[ 8 ];   // "ABIFCOL"
+    uint32_t    nVersion;
+    uint32_t    nByteOrder;     // colBYTEORDER as written
+    uint32_t    nColumns;       // entries in the directory
+    uint32_t    nReserved;
+    uint64_t    nDirectory;     // offset of the column directory
+    uint64_t    nFileSize;
+    char        szPadding[ 24 ];
+};
+
+struct ABICOLUMN
+{
+    char        szTable[ 24 ];  // "signal", "lod <column>" or the peak caption
+    char        szName[ 24 ];   // column caption
+    uint32_t    nType;          // AbiColumnType
+    uint32_t    nWidth;         // bytes per element
+    uint64_t    nOffset;        // first element, from the start of the file
+    uint64_t    nCount;         // number of elements
+};
+
+/*
+ * builds the file in memory and writes it with a single call; keep one per
+ * thread and reuse it so the buffers are allocated once
+*/
+class AbiColumnWriter
+{
+public:
+    AbiColumnWriter() : pStats( NULL ) {}
+    ~AbiColumnWriter() {}
+
+    void Clear()    { vColumn.clear(); vData.clear(); }
+    void AddSignal( pmr::list<SIGNAL>& );
+    void AddPeak( list<PEAK>& );
+    void AddPeak( vector<PEAKTABLE>& );
+    void AddPyramid( const string&, const AbiPyramid& );
+    static string GetSignalName( const SIGNAL& );    // its column in table "signal"
+    bool Write( const string& );
+    bool Write( int, uint64_t );    // at an offset of an open file
+    uint64_t GetFileSize() const;
+
+    // time every Write into _s; NULL to stop
+    void SetStats( AbiStats* _s )   { pStats = _s; }
+
+private:
+    vector<ABICOLUMN>   vColumn;
+    vector<char>        vData;      // column data; offsets relative to here
+    vector<int16_t>     vShort;     // conversion scratch
+    vector<int32_t>     vLong;
+    vector<float>       vFloat;
+    AbiStats*           pStats;     // NULL if not measured
+
+    void AddColumn( const string&, const char*, AbiColumnType, uint32_t, const void*, size_t );
+};
+
+/*
+ * maps a columnar file read-only; the columns are used in place, nothing
+ * is parsed beyond checking the header and the directory
+*/
+class AbiColumnFile
+{
+public:
+    AbiColumnFile() : szBuffer( NULL ), nSize( 0 ), pHeader( NULL ), pColumn( NULL ), bMapped( false ) {}
+    ~AbiColumnFile()    { Close(); }
+
+    bool Open( const char* );
+    bool Open( const void*, size_t );   // an image in memory, used in place
+    void Close();
+
+    int GetColumnCount() const  { return( pHeader ? static_cast<int>( pHeader->nColumns ) : 0 ); }
+    const ABICOLUMN& GetColumn( int _i ) const  { return( pColumn[ _i ] ); }
+    int FindColumn( const char*, const char*, int = 0 ) const;
+
+    // NULL if the column holds a different type
+    const int16_t*  GetShort( int ) const;
+    const int32_t*  GetLong( int ) const;
+    const float*    GetFloat( int ) const;
+    const uint8_t*  GetByte( int ) const;
+    const char*     GetChar( int ) const;   // GetColumn().nWidth bytes per label
+
+private:
+    const unsigned char*    szBuffer;
+    size_t                  nSize;
+    const ABICOLHEADER*     pHeader;
+    const ABICOLUMN*        pColumn;
+    bool                    bMapped;    // szBuffer is ours to unmap
+
+    AbiColumnFile( const AbiColumnFile& );
+    AbiColumnFile& operator=( const AbiColumnFile& );
+
+    const void* GetData( int, AbiColumnType ) const;
+};
+
+#endif  // _ABI_COL_H
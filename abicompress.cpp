@@ -0,0 +1,182 @@
+/*
+ * abicompress.cpp
+ *
+ * block compression of the output files on a pool of threads
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <zlib.h>
+
+#ifdef _ABI_ZSTD
+#include <zstd.h>
+#endif
+
+#include <abistats.h>
+#include <abicompress.h>
+
+AbiCompressor::AbiCompressor(
+    AbiCompression _method, int _level, int _threads ) :
+    nMethod( _method ), nLevel( _level ), bFinish( false ),
+    nBytesIn( 0 ), nBytesOut( 0 ), nTime( 0 )
+{
+    int size = ( _method == abiCOMPRESS_NONE ) ? 0 : ( ( _threads > 0 ) ? _threads : 1 );
+
+    for ( int i = 0; i < size; ++i )
+    {
+        vThread.push_back( thread( &AbiCompressor::Run, this ) );
+    }
+}
+
+AbiCompressor::~AbiCompressor()
+{
+    {
+        lock_guard<mutex> lock( mLock ); bFinish = true;
+    }
+
+    cvWork.notify_all();
+
+    for ( size_t i = 0; i < vThread.size(); ++i )
+    {
+        vThread[ i ].join();
+    }
+}
+
+bool AbiCompressor::IsAvailable(
+    AbiCompression _method )
+{
+#ifdef _ABI_ZSTD
+    return( true );
+#else
+    return( !( _method == abiCOMPRESS_ZSTD ) );
+#endif
+}
+
+const char* AbiCompressor::GetSuffix(
+    AbiCompression _method )
+{
+    switch ( _method )
+    {
+    case abiCOMPRESS_GZIP:  return( ".gz" );
+    case abiCOMPRESS_ZSTD:  return( ".zst" );
+    default:                return( "" );
+    }
+}
+
+void AbiCompressor::Submit(
+    ABIBLOCK& _block )
+{
+    {
+        lock_guard<mutex> lock( mLock );
+
+        _block.bDone = _block.bError = false;
+        dqBlock.push_back( &_block );
+    }
+
+    cvWork.notify_one();
+}
+
+void AbiCompressor::Wait(
+    ABIBLOCK& _block )
+{
+    unique_lock<mutex> lock( mLock );
+
+    while ( !_block.bDone )
+    {
+        cvDone.wait( lock );
+    }
+}
+
+/*
+ * every thread keeps its own zlib stream or zstd context and resets it for
+ * each block, so nothing is allocated once the blocks have their size
+*/
+void AbiCompressor::Run()
+{
+    z_stream zs;
+    bool gzip = false;
+
+#ifdef _ABI_ZSTD
+    ZSTD_CCtx* zstd = ( nMethod == abiCOMPRESS_ZSTD ) ? ZSTD_createCCtx() : NULL;
+#endif
+
+    if ( nMethod == abiCOMPRESS_GZIP )
+    {
+        zs.zalloc = Z_NULL; zs.zfree = Z_NULL; zs.opaque = Z_NULL;
+
+        // 15 bits of window, plus 16 for the gzip header and trailer
+        gzip = ( deflateInit2( &zs, nLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) == Z_OK );
+    }
+
+    for ( ;; )
+    {
+        ABIBLOCK* block;
+
+        {
+            unique_lock<mutex> lock( mLock );
+
+            while ( dqBlock.empty() && !bFinish )
+            {
+                cvWork.wait( lock );
+            }
+
+            if ( dqBlock.empty() )
+            {
+                break;
+            }
+
+            block = dqBlock.front(); dqBlock.pop_front();
+        }
+
+        uint64_t start = AbiGetClock();
+        bool ok = false;
+
+        if ( nMethod == abiCOMPRESS_GZIP && gzip )
+        {
+            block->vOutput.resize( deflateBound( &zs, block->nInput ) );
+
+            zs.next_in = reinterpret_cast<Bytef*>( block->vInput.data() );
+            zs.avail_in = block->nInput;
+            zs.next_out = reinterpret_cast<Bytef*>( block->vOutput.data() );
+            zs.avail_out = block->vOutput.size();
+
+            ok = ( deflate( &zs, Z_FINISH ) == Z_STREAM_END );
+            block->nOutput = block->vOutput.size() - zs.avail_out;
+            deflateReset( &zs );
+        }
+
+#ifdef _ABI_ZSTD
+        if ( nMethod == abiCOMPRESS_ZSTD && zstd )
+        {
+            block->vOutput.resize( ZSTD_compressBound( block->nInput ) );
+
+            size_t n = ZSTD_compressCCtx( zstd, block->vOutput.data(), block->vOutput.size(),
+                block->vInput.data(), block->nInput, nLevel );
+
+            ok = !ZSTD_isError( n );
+            block->nOutput = ok ? n : 0;
+        }
+#endif
+
+        uint64_t elapsed = AbiGetClock() - start;
+
+        {
+            lock_guard<mutex> lock( mLock );
+
+            block->bError = !ok; block->bDone = true;
+            nBytesIn += block->nInput; nBytesOut += ok ? block->nOutput : 0;
+            nTime += elapsed;
+        }
+
+        cvDone.notify_all();
+    }
+
+    if ( gzip )
+    {
+        deflateEnd( &zs );
+    }
+
+#ifdef _ABI_ZSTD
+    ZSTD_freeCCtx( zstd );
+#endif
+}   // end of Run()
@@ -0,0 +1,97 @@
+/*
+ * abicompress.h
+ *
+ * block compression of the output files on a pool of threads
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_COMPRESS_H
+#define _ABI_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C++ header files
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+using namespace std;
+
+/*
+ * zstd is only there when built with -D_ABI_ZSTD and linked with -lzstd
+*/
+enum AbiCompression
+{
+    abiCOMPRESS_NONE,
+    abiCOMPRESS_GZIP,   // zlib, a gzip member per block
+    abiCOMPRESS_ZSTD    // a zstd frame per block
+};
+
+/*
+ * one block of an output file; the writer fills the input, the compressor
+ * the output. the vectors keep their capacity from one block to the next
+*/
+struct ABIBLOCK
+{
+    vector<char> vInput;
+    size_t nInput;          // bytes of the input in use
+    vector<char> vOutput;
+    size_t nOutput;         // bytes of the output in use
+    bool bDone;             // compressed, or failed
+    bool bError;
+};
+
+/*
+ * compresses blocks on its own threads, in the order they are submitted;
+ * no threads are started for abiCOMPRESS_NONE.
+ * every block is a complete gzip member or zstd frame, and these can be
+ * concatenated, so a file written block by block decompresses as a whole
+ * with gzip -d or zstd -d. writers wait for their blocks with Wait and write
+ * them in order. one compressor is shared by all the writers of a run
+*/
+class AbiCompressor
+{
+public:
+    AbiCompressor( AbiCompression, int, int );
+    ~AbiCompressor();
+
+    void Submit( ABIBLOCK& );
+    void Wait( ABIBLOCK& );
+
+    AbiCompression GetMethod() const    { return( nMethod ); }
+    int GetLevel() const            { return( nLevel ); }
+    int GetThreadCount() const      { return( static_cast<int>( vThread.size() ) ); }
+
+    // totals over all blocks; the time is summed over the threads (ns)
+    uint64_t GetBytesIn() const     { return( nBytesIn ); }
+    uint64_t GetBytesOut() const    { return( nBytesOut ); }
+    uint64_t GetTime() const        { return( nTime ); }
+
+    static bool IsAvailable( AbiCompression );
+    static const char* GetSuffix( AbiCompression );
+
+private:
+    AbiCompression  nMethod;
+    int             nLevel;
+    vector<thread>  vThread;
+
+    mutex               mLock;
+    condition_variable  cvWork;     // a block was submitted
+    condition_variable  cvDone;     // a block was compressed
+    deque<ABIBLOCK*>    dqBlock;
+    bool                bFinish;
+    uint64_t            nBytesIn;
+    uint64_t            nBytesOut;
+    uint64_t            nTime;
+
+    AbiCompressor( const AbiCompressor& );
+    AbiCompressor& operator=( const AbiCompressor& );
+
+    void Run();
+};
+
+#endif  // _ABI_COMPRESS_H
@@ -0,0 +1,353 @@
+/*
+ * abicsv.cpp
+ *
+ * buffered CSV writer for the signal and peak tables
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <charconv>
+
+#include <abitag.h>
+#include <abifile.h>
+#include <abicsv.h>
+#include <abistats.h>
+#include <abicompress.h>
+
+// longest field to_chars can produce for an int or a float
+const size_t csvFIELDSIZE = 32;
+
+// buffers of one writer in flight to the compressor
+const size_t csvBLOCKS = 4;
+
+AbiCsvWriter::AbiCsvWriter(
+    size_t _size ) :
+    vBuffer( ( _size > csvFIELDSIZE ) ? _size : csvFIELDSIZE ), nUsed( 0 ), nFile( -1 ),
+    bError( false ), nBytes( 0 ), pStats( NULL ), nStart( 0 ), nValues( 0 ), pCompressor( NULL ),
+    nFirst( 0 ), nPending( 0 )
+{
+}
+
+AbiCsvWriter::~AbiCsvWriter()
+{
+    Close();
+}
+
+void AbiCsvWriter::SetCompressor(
+    AbiCompressor* _c )
+{
+    Close();
+
+    pCompressor = _c;
+    vBlock.resize( _c ? csvBLOCKS : 0 );
+}
+
+bool AbiCsvWriter::Open(
+    const char* _filename )
+{
+    Close();
+
+    nFile = open( _filename, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    nUsed = 0; nBytes = 0; bError = false;
+    nStart = pStats ? AbiGetClock() : 0; nValues = 0;
+
+    return( !( nFile < 0 ) );
+}
+
+bool AbiCsvWriter::Close()
+{
+    if ( nFile < 0 )
+    {
+        return( false );
+    }
+
+    Flush();
+
+    while ( nPending > 0 )
+    {
+        WriteBlock();
+    }
+
+    if ( close( nFile ) )
+    {
+        bError = true;
+    }
+
+    nFile = -1;
+
+    if ( pStats )
+    {
+        pStats->Add( abiSTAGE_CSV, AbiGetClock() - nStart, nBytes, nValues );
+    }
+
+    return( !bError );
+}
+
+/*
+ * hand the buffer to the kernel, or to the compressor; the buffer is swapped
+ * with the next block of the ring, waiting for the oldest block to be
+ * written if all of them are in flight, so formatting goes on while the
+ * earlier blocks are compressed
+*/
+bool AbiCsvWriter::Flush()
+{
+    if ( !pCompressor )
+    {
+        WriteAll( vBuffer.data(), nUsed );
+        nUsed = 0;
+
+        return( !bError );
+    }
+
+    if ( nUsed == 0 )
+    {
+        return( !bError );
+    }
+
+    if ( !( nPending < vBlock.size() ) )
+    {
+        WriteBlock();
+    }
+
+    ABIBLOCK& block = vBlock[ ( nFirst + nPending ) % vBlock.size() ];
+    size_t size = vBuffer.size();
+
+    block.vInput.swap( vBuffer ); block.nInput = nUsed;
+    vBuffer.resize( size );
+
+    pCompressor->Submit( block );
+    ++nPending; nUsed = 0;
+
+    return( !bError );
+}   // end of Flush()
+
+/*
+ * the oldest block once it is compressed; the blocks are written in order
+*/
+void AbiCsvWriter::WriteBlock()
+{
+    ABIBLOCK& block = vBlock[ nFirst ];
+
+    pCompressor->Wait( block );
+
+    if ( block.bError )
+    {
+        bError = true;
+    }
+    else
+    {
+        WriteAll( block.vOutput.data(), block.nOutput );
+    }
+
+    nFirst = ( nFirst + 1 ) % vBlock.size(); --nPending;
+}
+
+/*
+ * the only place that issues write(2)
+*/
+void AbiCsvWriter::WriteAll(
+    const char* _data, size_t _size )
+{
+    size_t offset = 0;
+
+    while ( offset < _size && !bError )
+    {
+        ssize_t n = write( nFile, _data + offset, _size - offset );
+
+        if ( n < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if ( n < 0 )
+        {
+            bError = true; break;
+        }
+
+        offset += n;
+    }
+
+    nBytes += offset;
+}
+
+/*
+ * make room for _size bytes at the end of the buffer
+*/
+char* AbiCsvWriter::Reserve(
+    size_t _size )
+{
+    if ( nUsed + _size > vBuffer.size() )
+    {
+        Flush();
+    }
+
+    return( &vBuffer[ nUsed ] );
+}
+
+void AbiCsvWriter::Put(
+    const char* _s, size_t _n )
+{
+    while ( _n > 0 )
+    {
+        if ( !( nUsed < vBuffer.size() ) )
+        {
+            Flush();
+        }
+
+        size_t n = ( _n < vBuffer.size() - nUsed ) ? _n : vBuffer.size() - nUsed;
+        memcpy( &vBuffer[ nUsed ], _s, n );
+        nUsed += n; _s += n; _n -= n;
+    }
+}
+
+/*
+ * a quoted field; quotes inside it are doubled
+*/
+void AbiCsvWriter::PutQuoted(
+    const char* _s )
+{
+    Put( '"' );
+
+    for ( const char* q = strchr( _s, '"' ); q; q = strchr( _s, '"' ) )
+    {
+        Put( _s, q - _s + 1 ); Put( '"' ); _s = q + 1;
+    }
+
+    Put( _s, strlen( _s ) ); Put( '"' );
+}
+
+void AbiCsvWriter::PutInt(
+    int _value )
+{
+    char* p = Reserve( csvFIELDSIZE );
+    nUsed += to_chars( p, p + csvFIELDSIZE, _value ).ptr - p; ++nValues;
+}
+
+void AbiCsvWriter::PutFloat(
+    float _value )
+{
+    char* p = Reserve( csvFIELDSIZE );
+    nUsed += to_chars( p, p + csvFIELDSIZE, _value ).ptr - p; ++nValues;
+}
+
+/*
+ * the signals side by side: a caption row, then one row per sample
+*/
+bool AbiCsvWriter::WriteCSV(
+    const string& _filename, pmr::list<SIGNAL>& _signal )
+{
+    if ( _signal.empty() || !Open( _filename.c_str() ) )
+    {
+        return( false );
+    }
+
+    vector<const pmr::vector<int>*>& column = vColumn;
+    pmr::list<SIGNAL>::iterator filter;
+
+    column.clear();
+
+    // first write all the captions
+    for ( filter = _signal.begin(); !( filter == _signal.end() ); ++filter )
+    {
+        if ( !column.empty() )
+        {
+            Put( ',' );
+        }
+
+        PutQuoted( ( *filter ).szCaption.c_str() );
+        column.push_back( &( *filter ).vSignal );
+    }
+
+    Put( '\n' );
+
+    // now write all the data; the first signal sets the number of rows
+    size_t rows = column[ 0 ]->size();
+
+    for ( size_t i = 0; i < rows; ++i )
+    {
+        PutInt( ( *column[ 0 ] )[ i ] );
+
+        for ( size_t k = 1; k < column.size(); ++k )
+        {
+            Put( ',' );
+
+            if ( i < column[ k ]->size() )
+            {
+                PutInt( ( *column[ k ] )[ i ] );
+            }
+        }
+
+        Put( '\n' );
+    }
+
+    return( Close() );
+}   // end of WriteCSV()
+
+/*
+ * one block per filter: caption, column names and one row per peak
+*/
+bool AbiCsvWriter::WriteCSV(
+    const string& _filename, list<PEAK>& _peak )
+{
+    if ( !Open( _filename.c_str() ) )
+    {
+        return( false );
+    }
+
+    const char szHEADER[] = "\"Position\",\"Height\",\"BeginPeak\",\"EndPeak\","
+        "\"BeginHeight\",\"EndHeight\",\"Area\",\"Size\"\n";
+
+    for ( list<PEAK>::iterator peak = _peak.begin(); !( peak == _peak.end() ); ++peak )
+    {
+        // first write the filter name
+        PutQuoted( ( *peak ).szCaption.c_str() ); Put( '\n' );
+        Put( szHEADER, sizeof( szHEADER ) - 1 );
+
+        list<PEAKDATA>::iterator p;
+
+        // now, write all the data
+        for ( p = ( *peak ).lpPeak.begin(); !( p == ( *peak ).lpPeak.end() ); ++p )
+        {
+            PutInt( ( *p ).nPoint ); Put( ',' ); PutInt( ( *p ).nHeight ); Put( ',' );
+            PutInt( ( *p ).nBegin ); Put( ',' ); PutInt( ( *p ).nEnd ); Put( ',' );
+            PutInt( ( *p ).nBeginHi ); Put( ',' ); PutInt( ( *p ).nEndHi ); Put( ',' );
+            PutInt( ( *p ).nArea ); Put( ',' );
+            PutFloat( static_cast<float>( ( *p ).dSize ) ); Put( '\n' );
+        }
+    }
+
+    return( Close() );
+}   // end of WriteCSV()
+
+bool AbiCsvWriter::WriteCSV(
+    const string& _filename, vector<PEAKTABLE>& _peak )
+{
+    if ( !Open( _filename.c_str() ) )
+    {
+        return( false );
+    }
+
+    const char szHEADER[] = "\"Position\",\"Height\",\"BeginPeak\",\"EndPeak\","
+        "\"BeginHeight\",\"EndHeight\",\"Area\",\"Size\"\n";
+
+    for ( vector<PEAKTABLE>::iterator t = _peak.begin(); !( t == _peak.end() ); ++t )
+    {
+        PutQuoted( ( *t ).szCaption.c_str() ); Put( '\n' );
+        Put( szHEADER, sizeof( szHEADER ) - 1 );
+
+        for ( int i = 0; i < ( *t ).nCount; ++i )
+        {
+            PutInt( ( *t ).vPosition[ i ] ); Put( ',' ); PutInt( ( *t ).vHeight[ i ] ); Put( ',' );
+            PutInt( ( *t ).vBegin[ i ] ); Put( ',' ); PutInt( ( *t ).vEnd[ i ] ); Put( ',' );
+            PutInt( ( *t ).vBeginHi[ i ] ); Put( ',' ); PutInt( ( *t ).vEndHi[ i ] ); Put( ',' );
+            PutInt( ( *t ).vArea[ i ] ); Put( ',' );
+            PutFloat( ( *t ).vSize[ i ] ); Put( '\n' );
+        }
+    }
+
+    return( Close() );
+}   // end of WriteCSV()
@@ -0,0 +1,93 @@
+/*
+ * abicsv.h
+ *
+ * buffered CSV writer for the signal and peak tables
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_CSV_H
+#define _ABI_CSV_H
+
+// C++ header files
+#include <list>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct SIGNAL;
+struct PEAK;
+struct PEAKTABLE;
+struct ABIBLOCK;
+class AbiStats;
+class AbiCompressor;
+
+/*
+ * rows are formatted with to_chars into one large buffer that is handed to
+ * write(2) only when it fills up or the file is closed; keep one writer per
+ * thread and reuse it across files so the buffer is allocated once
+*/
+class AbiCsvWriter
+{
+public:
+    explicit AbiCsvWriter( size_t = 1 << 20 );
+    ~AbiCsvWriter();
+
+    bool Open( const char* );
+    bool Close();       // flush and close; false if anything failed to write
+
+    bool WriteCSV( const string&, pmr::list<SIGNAL>& );
+    bool WriteCSV( const string&, list<PEAK>& );
+    bool WriteCSV( const string&, vector<PEAKTABLE>& );
+
+    void Put( char _c )
+    {
+        if ( !( nUsed < vBuffer.size() ) )
+        {
+            Flush();
+        }
+
+        vBuffer[ nUsed++ ] = _c;
+    }
+
+    void Put( const char*, size_t );
+    void Put( const string& _s )    { Put( _s.data(), _s.length() ); }
+    void PutQuoted( const char* );
+    void PutInt( int );
+    void PutFloat( float );     // shortest text that reads back the same float
+
+    unsigned long long GetBytes() const { return( nBytes ); }
+
+    // time every file from Open to Close into _s; NULL to stop
+    void SetStats( AbiStats* _s )   { pStats = _s; }
+
+    // compress the files opened from now on with _c; NULL for plain files
+    void SetCompressor( AbiCompressor* );
+
+private:
+    vector<char>    vBuffer;
+    size_t          nUsed;      // bytes formatted but not yet written
+    int             nFile;      // output file descriptor
+    bool            bError;     // a write failed since the file was opened
+    unsigned long long nBytes;  // bytes written to the current file
+    vector<const pmr::vector<int>*> vColumn;    // signals being written
+    AbiStats*       pStats;     // NULL if not measured
+    uint64_t        nStart;     // when the file was opened
+    uint64_t        nValues;    // numbers formatted into the current file
+    AbiCompressor*  pCompressor;    // NULL if the files are written as they are
+    vector<ABIBLOCK> vBlock;    // ring of the buffers being compressed
+    size_t          nFirst;     // oldest block not yet written
+    size_t          nPending;   // blocks submitted but not yet written
+
+    AbiCsvWriter( const AbiCsvWriter& );
+    AbiCsvWriter& operator=( const AbiCsvWriter& );
+
+    bool Flush();
+    void WriteAll( const char*, size_t );
+    void WriteBlock();
+    char* Reserve( size_t );
+};
+
+#endif  // _ABI_CSV_H
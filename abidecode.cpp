@@ -0,0 +1,525 @@
+/*
+ * abidecode.cpp
+ *
+ * bulk decoders for the big-endian arrays stored in ABI tracefiles
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <string.h>
+
+#include <abidecode.h>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+    #define ABI_DECODE_X86
+    #include <immintrin.h>
+#endif
+
+typedef void ( *SHORTDECODER )( const unsigned char*, int*, size_t );
+typedef void ( *INT16DECODER )( const unsigned char*, int16_t*, size_t );
+typedef void ( *LONGDECODER )( const unsigned char*, int*, size_t );
+typedef void ( *FLOATDECODER )( const unsigned char*, double*, size_t );
+typedef void ( *PEAKDECODER )( const unsigned char*, const ABIPEAKCOLUMN&, size_t );
+
+static const size_t nPEAKRECORD = 96;
+static const size_t nPEAKLABEL = 64;
+
+/*
+ * portable versions; also used for the tail of the vectorized loops
+*/
+static void DecodeShortScalar(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    for ( size_t i = 0; i < _count; ++i, _src += 2 )
+    {
+        _dst[ i ] = ( _src[ 0 ] << 0x8 ) | _src[ 1 ];
+    }
+}
+
+static void DecodeInt16Scalar(
+    const unsigned char* _src, int16_t* _dst, size_t _count )
+{
+    for ( size_t i = 0; i < _count; ++i, _src += 2 )
+    {
+        _dst[ i ] = static_cast<int16_t>( ( _src[ 0 ] << 0x8 ) | _src[ 1 ] );
+    }
+}
+
+static void DecodeLongScalar(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    for ( size_t i = 0; i < _count; ++i, _src += 4 )
+    {
+        _dst[ i ] = static_cast<int>( ( static_cast<unsigned int>( _src[ 0 ] ) << 0x18 ) |
+            ( _src[ 1 ] << 0x10 ) | ( _src[ 2 ] << 0x8 ) | _src[ 3 ] );
+    }
+}
+
+static void DecodeFloatScalar(
+    const unsigned char* _src, double* _dst, size_t _count )
+{
+    unsigned int value;
+    float f;
+
+    for ( size_t i = 0; i < _count; ++i, _src += 4 )
+    {
+        value = ( static_cast<unsigned int>( _src[ 0 ] ) << 0x18 ) |
+            ( _src[ 1 ] << 0x10 ) | ( _src[ 2 ] << 0x8 ) | _src[ 3 ];
+        memcpy( &f, &value, sizeof( f ) );
+        _dst[ i ] = f;
+    }
+}
+
+/*
+ * position, height, begin, end, begin height, end height, area, volume, size,
+ * edit flag and label at bytes 0, 4, 6, 10, 14, 16, 18, 22, 26, 30 and 32
+*/
+static void DecodePeakScalar(
+    const unsigned char* _src, const ABIPEAKCOLUMN& _dst, size_t _count )
+{
+    for ( size_t i = 0; i < _count; ++i, _src += nPEAKRECORD )
+    {
+        DecodeLongScalar( _src, _dst.pPosition + i, 1 );
+        _dst.pHeight[ i ] = ( _src[ 4 ] << 0x8 ) | _src[ 5 ];
+        DecodeLongScalar( _src + 6, _dst.pBegin + i, 1 );
+        DecodeLongScalar( _src + 10, _dst.pEnd + i, 1 );
+        _dst.pBeginHeight[ i ] = ( _src[ 14 ] << 0x8 ) | _src[ 15 ];
+        _dst.pEndHeight[ i ] = ( _src[ 16 ] << 0x8 ) | _src[ 17 ];
+        DecodeLongScalar( _src + 18, _dst.pArea + i, 1 );
+        DecodeLongScalar( _src + 22, _dst.pVolume + i, 1 );
+
+        unsigned int value = ( static_cast<unsigned int>( _src[ 26 ] ) << 0x18 ) |
+            ( _src[ 27 ] << 0x10 ) | ( _src[ 28 ] << 0x8 ) | _src[ 29 ];
+        memcpy( _dst.pSize + i, &value, sizeof( float ) );
+
+        _dst.pEdit[ i ] = ( _src[ 30 ] | _src[ 31 ] ) ? 1 : 0;
+        memcpy( _dst.pLabel + i * nPEAKLABEL, _src + 32, nPEAKLABEL );
+    }
+}
+
+// the same columns starting at record _i
+static ABIPEAKCOLUMN OffsetPeak(
+    const ABIPEAKCOLUMN& _dst, size_t _i )
+{
+    ABIPEAKCOLUMN d = { _dst.pPosition + _i, _dst.pHeight + _i, _dst.pBegin + _i,
+        _dst.pEnd + _i, _dst.pBeginHeight + _i, _dst.pEndHeight + _i, _dst.pArea + _i,
+        _dst.pVolume + _i, _dst.pSize + _i, _dst.pEdit + _i, _dst.pLabel + _i * nPEAKLABEL };
+
+    return( d );
+}
+
+#ifdef ABI_DECODE_X86
+/*
+ * SSE2: byte swap with shifts, widen with unpack
+*/
+static inline __m128i Swap32SSE2(
+    __m128i _x )
+{
+    __m128i x = _mm_or_si128( _mm_slli_epi16( _x, 8 ), _mm_srli_epi16( _x, 8 ) );
+
+    return( _mm_or_si128( _mm_slli_epi32( x, 16 ), _mm_srli_epi32( x, 16 ) ) );
+}
+
+static void DecodeShortSSE2(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for ( ; i + 8 <= _count; i += 8 )
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 2 * i ) );
+        x = _mm_or_si128( _mm_slli_epi16( x, 8 ), _mm_srli_epi16( x, 8 ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst + i ), _mm_unpacklo_epi16( x, zero ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst + i + 4 ), _mm_unpackhi_epi16( x, zero ) );
+    }
+
+    DecodeShortScalar( _src + 2 * i, _dst + i, _count - i );
+}
+
+static void DecodeInt16SSE2(
+    const unsigned char* _src, int16_t* _dst, size_t _count )
+{
+    size_t i = 0;
+
+    for ( ; i + 8 <= _count; i += 8 )
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 2 * i ) );
+        x = _mm_or_si128( _mm_slli_epi16( x, 8 ), _mm_srli_epi16( x, 8 ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst + i ), x );
+    }
+
+    DecodeInt16Scalar( _src + 2 * i, _dst + i, _count - i );
+}
+
+static void DecodeLongSSE2(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    size_t i = 0;
+
+    for ( ; i + 4 <= _count; i += 4 )
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 4 * i ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst + i ), Swap32SSE2( x ) );
+    }
+
+    DecodeLongScalar( _src + 4 * i, _dst + i, _count - i );
+}
+
+static void DecodeFloatSSE2(
+    const unsigned char* _src, double* _dst, size_t _count )
+{
+    size_t i = 0;
+
+    for ( ; i + 4 <= _count; i += 4 )
+    {
+        __m128 x = _mm_castsi128_ps( Swap32SSE2(
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 4 * i ) ) ) );
+        _mm_storeu_pd( _dst + i, _mm_cvtps_pd( x ) );
+        _mm_storeu_pd( _dst + i + 2, _mm_cvtps_pd( _mm_movehl_ps( x, x ) ) );
+    }
+
+    DecodeFloatScalar( _src + 4 * i, _dst + i, _count - i );
+}
+
+/*
+ * SSSE3: a single pshufb swaps and zero extends four shorts at a time
+*/
+__attribute__(( target( "ssse3" ) ))
+static void DecodeShortSSSE3(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    const __m128i lo = _mm_setr_epi8( 1, 0, -1, -1, 3, 2, -1, -1, 5, 4, -1, -1, 7, 6, -1, -1 );
+    const __m128i hi = _mm_setr_epi8( 9, 8, -1, -1, 11, 10, -1, -1, 13, 12, -1, -1, 15, 14, -1, -1 );
+    size_t i = 0;
+
+    for ( ; i + 8 <= _count; i += 8 )
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 2 * i ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst + i ), _mm_shuffle_epi8( x, lo ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst + i + 4 ), _mm_shuffle_epi8( x, hi ) );
+    }
+
+    DecodeShortScalar( _src + 2 * i, _dst + i, _count - i );
+}
+
+__attribute__(( target( "ssse3" ) ))
+static void DecodeInt16SSSE3(
+    const unsigned char* _src, int16_t* _dst, size_t _count )
+{
+    const __m128i swap = _mm_setr_epi8( 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+    size_t i = 0;
+
+    for ( ; i + 8 <= _count; i += 8 )
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 2 * i ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst + i ), _mm_shuffle_epi8( x, swap ) );
+    }
+
+    DecodeInt16Scalar( _src + 2 * i, _dst + i, _count - i );
+}
+
+__attribute__(( target( "ssse3" ) ))
+static void DecodeLongSSSE3(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    const __m128i swap = _mm_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    size_t i = 0;
+
+    for ( ; i + 4 <= _count; i += 4 )
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 4 * i ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst + i ), _mm_shuffle_epi8( x, swap ) );
+    }
+
+    DecodeLongScalar( _src + 4 * i, _dst + i, _count - i );
+}
+
+__attribute__(( target( "ssse3" ) ))
+static void DecodeFloatSSSE3(
+    const unsigned char* _src, double* _dst, size_t _count )
+{
+    const __m128i swap = _mm_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    size_t i = 0;
+
+    for ( ; i + 4 <= _count; i += 4 )
+    {
+        __m128 x = _mm_castsi128_ps( _mm_shuffle_epi8(
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 4 * i ) ), swap ) );
+        _mm_storeu_pd( _dst + i, _mm_cvtps_pd( x ) );
+        _mm_storeu_pd( _dst + i + 2, _mm_cvtps_pd( _mm_movehl_ps( x, x ) ) );
+    }
+
+    DecodeFloatScalar( _src + 4 * i, _dst + i, _count - i );
+}
+
+/*
+ * four records at a time: two loads and three pshufb pull the numbers of a
+ * record into one row each, then a 4x4 transpose turns the rows into columns
+*/
+__attribute__(( target( "ssse3" ) ))
+static void DecodePeakSSSE3(
+    const unsigned char* _src, const ABIPEAKCOLUMN& _dst, size_t _count )
+{
+    // bytes 0-15: position, height, begin, end
+    const __m128i a = _mm_setr_epi8( 3, 2, 1, 0, 5, 4, -1, -1, 9, 8, 7, 6, 13, 12, 11, 10 );
+    // bytes 14-29: begin height, end height, area, volume; size in the last lane
+    const __m128i b = _mm_setr_epi8( 1, 0, -1, -1, 3, 2, -1, -1, 7, 6, 5, 4, 11, 10, 9, 8 );
+    const __m128i c = _mm_setr_epi8( 15, 14, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+    size_t i = 0;
+
+    for ( ; i + 4 <= _count; i += 4 )
+    {
+        __m128 x[ 4 ], y[ 4 ];
+        __m128i z[ 4 ];
+
+        for ( int k = 0; k < 4; ++k )
+        {
+            const unsigned char* p = _src + ( i + k ) * nPEAKRECORD;
+            __m128i lo = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+            __m128i hi = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p + 14 ) );
+
+            x[ k ] = _mm_castsi128_ps( _mm_shuffle_epi8( lo, a ) );
+            y[ k ] = _mm_castsi128_ps( _mm_shuffle_epi8( hi, b ) );
+            z[ k ] = _mm_shuffle_epi8( hi, c );
+
+            _dst.pEdit[ i + k ] = ( p[ 30 ] | p[ 31 ] ) ? 1 : 0;
+            memcpy( _dst.pLabel + ( i + k ) * nPEAKLABEL, p + 32, nPEAKLABEL );
+        }
+
+        _MM_TRANSPOSE4_PS( x[ 0 ], x[ 1 ], x[ 2 ], x[ 3 ] );
+        _MM_TRANSPOSE4_PS( y[ 0 ], y[ 1 ], y[ 2 ], y[ 3 ] );
+
+        int32_t* column[] = { _dst.pPosition, _dst.pHeight, _dst.pBegin, _dst.pEnd,
+            _dst.pBeginHeight, _dst.pEndHeight, _dst.pArea, _dst.pVolume };
+
+        for ( int k = 0; k < 4; ++k )
+        {
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( column[ k ] + i ), _mm_castps_si128( x[ k ] ) );
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( column[ k + 4 ] + i ), _mm_castps_si128( y[ k ] ) );
+        }
+
+        __m128i size = _mm_unpacklo_epi64(
+            _mm_unpacklo_epi32( z[ 0 ], z[ 1 ] ), _mm_unpacklo_epi32( z[ 2 ], z[ 3 ] ) );
+        _mm_storeu_ps( _dst.pSize + i, _mm_castsi128_ps( size ) );
+    }
+
+    DecodePeakScalar( _src + i * nPEAKRECORD, OffsetPeak( _dst, i ), _count - i );
+}
+
+/*
+ * AVX2: swap sixteen bytes, then widen straight into a 256-bit store
+*/
+__attribute__(( target( "avx2" ) ))
+static void DecodeShortAVX2(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    const __m128i swap = _mm_setr_epi8( 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+    size_t i = 0;
+
+    for ( ; i + 16 <= _count; i += 16 )
+    {
+        __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 2 * i ) );
+        __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 2 * i + 16 ) );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>( _dst + i ),
+            _mm256_cvtepu16_epi32( _mm_shuffle_epi8( a, swap ) ) );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>( _dst + i + 8 ),
+            _mm256_cvtepu16_epi32( _mm_shuffle_epi8( b, swap ) ) );
+    }
+
+    DecodeShortScalar( _src + 2 * i, _dst + i, _count - i );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void DecodeInt16AVX2(
+    const unsigned char* _src, int16_t* _dst, size_t _count )
+{
+    const __m256i swap = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+    size_t i = 0;
+
+    for ( ; i + 16 <= _count; i += 16 )
+    {
+        __m256i x = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( _src + 2 * i ) );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>( _dst + i ), _mm256_shuffle_epi8( x, swap ) );
+    }
+
+    DecodeInt16Scalar( _src + 2 * i, _dst + i, _count - i );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void DecodeLongAVX2(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    const __m256i swap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    size_t i = 0;
+
+    for ( ; i + 8 <= _count; i += 8 )
+    {
+        __m256i x = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( _src + 4 * i ) );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>( _dst + i ), _mm256_shuffle_epi8( x, swap ) );
+    }
+
+    DecodeLongScalar( _src + 4 * i, _dst + i, _count - i );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void DecodeFloatAVX2(
+    const unsigned char* _src, double* _dst, size_t _count )
+{
+    const __m128i swap = _mm_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    size_t i = 0;
+
+    for ( ; i + 4 <= _count; i += 4 )
+    {
+        __m128 x = _mm_castsi128_ps( _mm_shuffle_epi8(
+            _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src + 4 * i ) ), swap ) );
+        _mm256_storeu_pd( _dst + i, _mm256_cvtps_pd( x ) );
+    }
+
+    DecodeFloatScalar( _src + 4 * i, _dst + i, _count - i );
+}
+#endif  // ABI_DECODE_X86
+
+/*
+ * runtime dispatch
+*/
+struct DECODER
+{
+    AbiDecodeTarget nTarget;
+    SHORTDECODER    fnShort;
+    INT16DECODER    fnInt16;
+    LONGDECODER     fnLong;
+    FLOATDECODER    fnFloat;
+    PEAKDECODER     fnPeak;     // no SSE2 or AVX2 version of its own
+};
+
+static bool IsSupported(
+    AbiDecodeTarget _target )
+{
+    switch ( _target )
+    {
+    case abiDECODE_SCALAR:  return( true );
+#ifdef ABI_DECODE_X86
+    case abiDECODE_SSE2:    return( __builtin_cpu_supports( "sse2" ) );
+    case abiDECODE_SSSE3:   return( __builtin_cpu_supports( "ssse3" ) );
+    case abiDECODE_AVX2:    return( __builtin_cpu_supports( "avx2" ) );
+#endif
+    default:                return( false );
+    }
+}
+
+static DECODER GetDecoder(
+    AbiDecodeTarget _target )
+{
+    DECODER d = { abiDECODE_SCALAR, DecodeShortScalar, DecodeInt16Scalar, DecodeLongScalar,
+        DecodeFloatScalar, DecodePeakScalar };
+
+#ifdef ABI_DECODE_X86
+    switch ( _target )
+    {
+    case abiDECODE_SSE2:
+        d.fnShort = DecodeShortSSE2; d.fnInt16 = DecodeInt16SSE2;
+        d.fnLong = DecodeLongSSE2; d.fnFloat = DecodeFloatSSE2; break;
+    case abiDECODE_SSSE3:
+        d.fnShort = DecodeShortSSSE3; d.fnInt16 = DecodeInt16SSSE3;
+        d.fnLong = DecodeLongSSSE3; d.fnFloat = DecodeFloatSSSE3;
+        d.fnPeak = DecodePeakSSSE3; break;
+    case abiDECODE_AVX2:
+        d.fnShort = DecodeShortAVX2; d.fnInt16 = DecodeInt16AVX2;
+        d.fnLong = DecodeLongAVX2; d.fnFloat = DecodeFloatAVX2;
+        d.fnPeak = DecodePeakSSSE3; break;
+    default:
+        break;
+    }
+#endif
+
+    d.nTarget = _target;
+    return( d );
+}
+
+static DECODER SelectDecoder()
+{
+    AbiDecodeTarget target[] = { abiDECODE_AVX2, abiDECODE_SSSE3, abiDECODE_SSE2 };
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        if ( IsSupported( target[ i ] ) )
+        {
+            return( GetDecoder( target[ i ] ) );
+        }
+    }
+
+    return( GetDecoder( abiDECODE_SCALAR ) );
+}
+
+/*
+ * chosen on first use, so decoders are safe to call from static initializers
+*/
+static DECODER& GetActiveDecoder()
+{
+    static DECODER d = SelectDecoder();
+
+    return( d );
+}
+
+void AbiDecodeShort(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    GetActiveDecoder().fnShort( _src, _dst, _count );
+}
+
+void AbiDecodeInt16(
+    const unsigned char* _src, int16_t* _dst, size_t _count )
+{
+    GetActiveDecoder().fnInt16( _src, _dst, _count );
+}
+
+void AbiDecodeLong(
+    const unsigned char* _src, int* _dst, size_t _count )
+{
+    GetActiveDecoder().fnLong( _src, _dst, _count );
+}
+
+void AbiDecodeFloat(
+    const unsigned char* _src, double* _dst, size_t _count )
+{
+    GetActiveDecoder().fnFloat( _src, _dst, _count );
+}
+
+void AbiDecodePeak(
+    const unsigned char* _src, const ABIPEAKCOLUMN& _dst, size_t _count )
+{
+    GetActiveDecoder().fnPeak( _src, _dst, _count );
+}
+
+AbiDecodeTarget AbiGetDecodeTarget()
+{
+    return( GetActiveDecoder().nTarget );
+}
+
+/*
+ * force a particular instruction set; mostly for testing and benchmarks
+*/
+bool AbiSetDecodeTarget(
+    AbiDecodeTarget _target )
+{
+    if ( !IsSupported( _target ) )
+    {
+        return( false );
+    }
+
+    GetActiveDecoder() = GetDecoder( _target );
+    return( true );
+}
+
+const char* AbiGetDecodeName(
+    AbiDecodeTarget _target )
+{
+    const char* szNAME[] = { "scalar", "sse2", "ssse3", "avx2" };
+
+    return( szNAME[ _target ] );
+}
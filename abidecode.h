@@ -0,0 +1,62 @@
+/*
+ * abidecode.h
+ *
+ * bulk decoders for the big-endian arrays stored in ABI tracefiles
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_DECODE_H
+#define _ABI_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * instruction sets the decoders are compiled for; the best one the processor
+ * supports is picked the first time a decoder is used
+*/
+enum AbiDecodeTarget
+{
+    abiDECODE_SCALAR,
+    abiDECODE_SSE2,
+    abiDECODE_SSSE3,
+    abiDECODE_AVX2
+};
+
+/*
+ * each decoder converts _count elements starting at _src into _dst; the
+ * source may be unaligned and the destination must hold _count elements
+*/
+void AbiDecodeShort( const unsigned char*, int*, size_t );      // unsigned 16-bit
+void AbiDecodeInt16( const unsigned char*, int16_t*, size_t );  // signed 16-bit
+void AbiDecodeLong( const unsigned char*, int*, size_t );       // signed 32-bit
+void AbiDecodeFloat( const unsigned char*, double*, size_t );   // IEEE single
+
+/*
+ * columns for the 96 byte PEAK records: eight integers, the size, the edit
+ * flag and a 64 byte label. each column holds _count elements and the label
+ * column _count labels back to back
+*/
+struct ABIPEAKCOLUMN
+{
+    int32_t* pPosition;
+    int32_t* pHeight;
+    int32_t* pBegin;
+    int32_t* pEnd;
+    int32_t* pBeginHeight;
+    int32_t* pEndHeight;
+    int32_t* pArea;
+    int32_t* pVolume;
+    float* pSize;
+    uint8_t* pEdit;
+    char* pLabel;
+};
+
+void AbiDecodePeak( const unsigned char*, const ABIPEAKCOLUMN&, size_t );
+
+AbiDecodeTarget AbiGetDecodeTarget();
+bool AbiSetDecodeTarget( AbiDecodeTarget );     // false if not supported
+const char* AbiGetDecodeName( AbiDecodeTarget );
+
+#endif  // _ABI_DECODE_H
@@ -11,81 +11,467 @@
  *
  * last updated on August 1, 2004
 */
+#include <errno.h>
+
+#include <algorithm>
+
 #include <abitag.h>
 #include <abifile.h>
+#include <abidecode.h>
+
+static const char* abiERRORTEXT[] =
+{
+    "no error", "cannot open the file", "cannot read the file", "file is too short",
+    "not an ABIF file", "tag directory is out of bounds"
+};
 
 /*
- * open the ABI trace file
+ * open the ABI trace file; check IsLoaded or GetError for the outcome
 */
+AbiFile::AbiFile() :
+    szAbifBuffer( NULL ), nAbifSize( 0 ), bAbifMapped( false ),
+    nAbifFile( -1 ), nBytesRead( 0 ), nReadCount( 0 ), pStats( NULL ),
+    szAbifHeap( NULL ), nAbifHeapSize( 0 ), nAbifError( abiERROR_NONE ), nAbifErrno( 0 )
+{
+}
+
 AbiFile::AbiFile(
-    const char* _szFile )
+    const char* _szFile ) :
+    szAbifBuffer( NULL ), nAbifSize( 0 ), bAbifMapped( false ),
+    nAbifFile( -1 ), nBytesRead( 0 ), nReadCount( 0 ), pStats( NULL ),
+    szAbifHeap( NULL ), nAbifHeapSize( 0 ), nAbifError( abiERROR_NONE ), nAbifErrno( 0 )
 {
-    if ( !LoadFile( _szFile ) )
+    LoadFile( _szFile );
+}
+
+AbiFile::AbiFile(
+    string& _szFile ) :
+    szAbifBuffer( NULL ), nAbifSize( 0 ), bAbifMapped( false ),
+    nAbifFile( -1 ), nBytesRead( 0 ), nReadCount( 0 ), pStats( NULL ),
+    szAbifHeap( NULL ), nAbifHeapSize( 0 ), nAbifError( abiERROR_NONE ), nAbifErrno( 0 )
+{
+    LoadFile( _szFile.c_str() );
+}
+
+AbiFile::~AbiFile()
+{
+    Release();
+    delete [] szAbifHeap;
+}
+
+const char* AbiFile::GetErrorText(
+    AbiError _error )
+{
+    return( ( _error < abiERROR_NONE || _error > abiERROR_DIRECTORY ) ? "unknown error" : abiERRORTEXT[ _error ] );
+}
+
+/*
+ * give back the tracefile buffer; unmap or free depending on how it was loaded.
+ * the heap buffer of the buffered and lazy modes is kept for the next file
+*/
+void AbiFile::Release()
+{
+    if ( szAbifBuffer )
     {
-#ifdef _DEBUG
-        cout << "file failed to load" << endl;
-#endif
-        exit( 1 );
+        if ( bAbifMapped )
+        {
+            munmap( const_cast<unsigned char*>( szAbifBuffer ), nAbifSize );
+        }
+        else if ( !( szAbifBuffer == szAbifHeap ) )
+        {
+            delete [] szAbifBuffer;
+        }
     }
+
+    if ( !( nAbifFile < 0 ) )
+    {
+        close( nAbifFile );
+    }
+
+    szAbifBuffer = NULL; nAbifSize = 0; bAbifMapped = false;
+    nAbifFile = -1; nBytesRead = 0; nReadCount = 0;
+    abiTagList.clear(); abiTagIndex.Clear(); vAbifLoaded.clear();
 }
 
-AbiFile::AbiFile(
-    string& _szFile )
+/*
+ * drop whatever is loaded and remember why; always false
+*/
+bool AbiFile::Fail(
+    AbiError _error, int _errno )
+{
+    Release();
+    nAbifError = _error; nAbifErrno = _errno;
+
+    return( false );
+}
+
+/*
+ * the reused heap buffer, grown to at least _size bytes; it only ever grows,
+ * so a reader holds on to the largest file it has seen
+*/
+unsigned char* AbiFile::GetHeap(
+    size_t _size )
 {
-    if ( !LoadFile( _szFile.c_str() ) )
+    if ( _size > nAbifHeapSize )
     {
-#ifdef _DEBUG
-        cout << "file failed to load" << endl;
-#endif
-        exit( 1 );
+        delete [] szAbifHeap;
+        szAbifHeap = NULL; nAbifHeapSize = 0;
+
+        szAbifHeap = new unsigned char [ _size ];
+        nAbifHeapSize = _size;
+    }
+
+    return( szAbifHeap );
+}
+
+/*
+ * map the tracefile read-only; the accessors read straight from the mapping
+*/
+bool AbiFile::MapFile(
+    int _fd )
+{
+    void* p = mmap( NULL, nAbifSize, PROT_READ, MAP_PRIVATE, _fd, 0 );
+
+    if ( p == MAP_FAILED )
+    {
+        return( false );
+    }
+
+    // the tag directory sits at the end and the data is scattered in between,
+    // so ask for the whole file rather than sequential readahead
+    madvise( p, nAbifSize, MADV_WILLNEED );
+
+    szAbifBuffer = static_cast<const unsigned char*>( p );
+    bAbifMapped = true;
+    nBytesRead = nAbifSize;
+
+    return( true );
+}
+
+/*
+ * copy the tracefile into a heap buffer; for file systems that can't be mapped
+*/
+bool AbiFile::ReadFile(
+    int _fd )
+{
+    szAbifBuffer = GetHeap( nAbifSize );
+    bAbifMapped = false;
+
+    return( ReadRange( _fd, 0, nAbifSize ) );
+}
+
+/*
+ * read the header and the directory only; the buffer is as large as the file
+ * but the rest of it is filled as the tags are used
+*/
+bool AbiFile::LazyFile(
+    int _fd )
+{
+    szAbifBuffer = GetHeap( nAbifSize );
+    bAbifMapped = false;
+
+    if ( !ReadRange( _fd, 0, abifHEADERSIZE ) )
+    {
+        return( false );
+    }
+
+    AbiTagRecord abiMainTag( szAbifBuffer, 6 );
+    size_t entry = static_cast<unsigned int>( abiMainTag.GetDataValue() );
+    size_t size = static_cast<size_t>( abiMainTag.GetRecordCount() ) * abifTAGSIZE;
+
+    // leave the bounds check to LoadFile; just don't read past the end
+    if ( abiMainTag.GetRecordCount() < 0 || entry + size > nAbifSize )
+    {
+        return( true );
+    }
+
+    if ( !ReadRange( _fd, entry, entry + size ) )
+    {
+        return( false );
+    }
+
+    ABIRANGE header = { 0, abifHEADERSIZE }, directory = { entry, entry + size };
+    vAbifLoaded.push_back( header );
+    vAbifLoaded.push_back( directory );
+    nAbifFile = _fd;
+
+    return( true );
+}
+
+/*
+ * read [_begin, _end) of the file into the same place in the buffer
+*/
+bool AbiFile::ReadRange(
+    int _fd, size_t _begin, size_t _end )
+{
+    unsigned char* buffer = const_cast<unsigned char*>( szAbifBuffer );
+
+    ++nReadCount;
+
+    while ( _begin < _end )
+    {
+        ssize_t n = pread( _fd, buffer + _begin, _end - _begin, _begin );
+
+        if ( n < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if ( !( n > 0 ) )
+        {
+            return( false );
+        }
+
+        _begin += n; nBytesRead += n;
+    }
+
+    return( true );
+}
+
+/*
+ * lazy mode: read the requested ranges that are not in the buffer yet; ranges
+ * closer than abifCOALESCE bytes are merged into one read
+*/
+bool AbiFile::Fetch()
+{
+    if ( nAbifFile < 0 || vAbifRequest.empty() )
+    {
+        vAbifRequest.clear(); return( true );
+    }
+
+    sort( vAbifRequest.begin(), vAbifRequest.end(),
+        []( const ABIRANGE& a, const ABIRANGE& b ) { return( a.nBegin < b.nBegin ); } );
+
+    vector<ABIRANGE>::iterator last = vAbifRequest.begin();
+
+    for ( vector<ABIRANGE>::iterator i = last + 1; !( i == vAbifRequest.end() ); ++i )
+    {
+        if ( ( *i ).nBegin > ( *last ).nEnd + abifCOALESCE )
+        {
+            *( ++last ) = *i;
+        }
+        else
+        {
+            ( *last ).nEnd = max( ( *last ).nEnd, ( *i ).nEnd );
+        }
+    }
+
+    vAbifRequest.erase( last + 1, vAbifRequest.end() );
+
+    bool ok = true;
+
+    // read only the holes between the ranges that are already in
+    for ( vector<ABIRANGE>::iterator i = vAbifRequest.begin(); ok && !( i == vAbifRequest.end() ); ++i )
+    {
+        size_t begin = ( *i ).nBegin;
+
+        for ( vector<ABIRANGE>::iterator j = vAbifLoaded.begin();
+            ok && !( j == vAbifLoaded.end() ) && ( *j ).nBegin < ( *i ).nEnd; ++j )
+        {
+            if ( ( *j ).nEnd > begin )
+            {
+                ok = !( ( *j ).nBegin > begin ) || ReadRange( nAbifFile, begin, ( *j ).nBegin );
+                begin = max( begin, ( *j ).nEnd );
+            }
+        }
+
+        ok = ok && ( !( begin < ( *i ).nEnd ) || ReadRange( nAbifFile, begin, ( *i ).nEnd ) );
     }
+
+    // fold the new ranges into the loaded list, keeping it sorted and disjoint
+    vAbifLoaded.insert( vAbifLoaded.end(), vAbifRequest.begin(), vAbifRequest.end() );
+    vAbifRequest.clear();
+
+    sort( vAbifLoaded.begin(), vAbifLoaded.end(),
+        []( const ABIRANGE& a, const ABIRANGE& b ) { return( a.nBegin < b.nBegin ); } );
+
+    last = vAbifLoaded.begin();
+
+    for ( vector<ABIRANGE>::iterator i = last + 1; !( i == vAbifLoaded.end() ); ++i )
+    {
+        if ( ( *i ).nBegin > ( *last ).nEnd )
+        {
+            *( ++last ) = *i;
+        }
+        else
+        {
+            ( *last ).nEnd = max( ( *last ).nEnd, ( *i ).nEnd );
+        }
+    }
+
+    vAbifLoaded.erase( last + 1, vAbifLoaded.end() );
+
+    return( ok );
+}
+
+/*
+ * queue the payload of a tag for the next fetch; payloads of up to four bytes
+ * are stored in the tag itself
+*/
+void AbiFile::AddRange(
+    vector<AbiTagRecord>::iterator _i )
+{
+    size_t entry = static_cast<unsigned int>( ( *_i ).GetDataValue() );
+    size_t size = static_cast<size_t>( ( *_i ).GetRecordCount() ) * ( *_i ).GetRecordSize();
+
+    if ( size > 4 && !( entry + size > nAbifSize ) )
+    {
+        ABIRANGE range = { entry, entry + size };
+        vAbifRequest.push_back( range );
+    }
+}
+
+/*
+ * lazy mode: read the payload of ids _first to _last of the flag together
+*/
+bool AbiFile::FetchFlag(
+    const unsigned int _code, const int _first, const int _last )
+{
+    if ( nAbifFile < 0 )
+    {
+        return( true );
+    }
+
+    for ( int i = _first; !( i > _last ); ++i )
+    {
+        vector<AbiTagRecord>::iterator tag = FindFlag( _code, i );
+
+        if ( !( tag == abiTagList.end() ) )
+        {
+            AddRange( tag );
+        }
+    }
+
+    return( Fetch() );
 }
 
 /*
  * load the entire tracefile into memory
 */
 bool AbiFile::LoadFile(
-    const char* _szFilename )
+    const char* _szFilename, AbiLoadMode _mode )
 {
     struct stat fs;
+    AbiTimer timer( pStats, abiSTAGE_LOAD );
+
+    // drop the previously loaded file, if any
+    Reset();
 
-    // try to get the status of the file
-    if ( stat( _szFilename, &fs ) )
+    int fd = open( _szFilename, O_RDONLY );
+
+    if ( fd < 0 )
     {
-        return( false );
+        return( Fail( abiERROR_OPEN, errno ) );
     }
 
-    szAbifBuffer = new unsigned char [ fs.st_size ];
-    ifstream ifTraceFile( _szFilename, ios::in | ios::binary );
+    // try to get the status of the file; must hold at least the header
+    if ( fstat( fd, &fs ) )
+    {
+        int error = errno;
+        close( fd ); return( Fail( abiERROR_OPEN, error ) );
+    }
 
-    if ( !ifTraceFile )
+    if ( fs.st_size < abifHEADERSIZE )
     {
-        return( false );
+        close( fd ); return( Fail( abiERROR_SIZE ) );
+    }
+
+    nAbifSize = fs.st_size;
+    bool loaded;
+
+    if ( _mode == abiLAZY )
+    {
+        // the descriptor stays open for the tags read later on
+        loaded = LazyFile( fd );
+    }
+    else
+    {
+        loaded = ( _mode == abiMAPPED ) && MapFile( fd );
+        loaded = loaded || ReadFile( fd );
     }
 
-    ifTraceFile.read( reinterpret_cast<char*>( szAbifBuffer ), fs.st_size );
-    ifTraceFile.close();
+    int error = loaded ? 0 : errno;
+
+    if ( !( nAbifFile == fd ) )
+    {
+        close( fd );
+    }
+
+    if ( !loaded )
+    {
+        return( Fail( abiERROR_READ, error ) );
+    }
+
+    timer.Set( nBytesRead, 1 ); timer.Stop();
+
+    return( Parse() );
+}
+
+/*
+ * take over a tracefile somebody else has read, e.g. the prefetcher; the
+ * buffer must come from new[] and is freed by the object, even on failure
+*/
+bool AbiFile::LoadBuffer(
+    unsigned char* _szBuffer, size_t _nSize, AbiError _error, int _errno )
+{
+    Reset();
+
+    szAbifBuffer = _szBuffer; nAbifSize = _nSize;
+    bAbifMapped = false; nBytesRead = _nSize;
+
+    // no buffer means the file could not be read, for the reason given
+    if ( !szAbifBuffer )
+    {
+        return( Fail( _error, _errno ) );
+    }
+
+    if ( nAbifSize < static_cast<size_t>( abifHEADERSIZE ) )
+    {
+        return( Fail( abiERROR_SIZE ) );
+    }
+
+    return( Parse() );
+}
+
+/*
+ * check the signature and read the tag directory out of the buffer
+*/
+bool AbiFile::Parse()
+{
+    AbiTimer timer( pStats, abiSTAGE_PARSE );
 
     // make sure the file contains the ABI signature "ABIF"
     if ( strncmp( reinterpret_cast<const char*>( szAbifBuffer ), "ABIF", 4 ) )
     {
-        return( false );
+        return( Fail( abiERROR_SIGNATURE ) );
     }
 
     // now parse the file, begin with the main tag list
     AbiTagRecord abiMainTag( szAbifBuffer, 6 );
     unsigned int entry = abiMainTag.GetDataValue();
 
+    // the directory must lie entirely within the file, and not over the signature
+    if ( abiMainTag.GetRecordCount() < 0 || ( entry == 0 && abiMainTag.GetRecordCount() > 0 ) ||
+        entry + static_cast<size_t>( abiMainTag.GetRecordCount() ) * abifTAGSIZE > nAbifSize )
+    {
+        return( Fail( abiERROR_DIRECTORY ) );
+    }
+
+    // the array keeps its capacity from the previous file
+    abiTagList.reserve( abiMainTag.GetRecordCount() );
+
     for ( int i = 0; i < abiMainTag.GetRecordCount(); ++i )
     {
-        AbiTagRecord data( szAbifBuffer, entry );
-        abiTagList.push_back( data );
+        abiTagList.push_back( AbiTagRecord( szAbifBuffer, entry ) );
         entry += abifTAGSIZE;
     }
 
+    abiTagIndex.Build( abiTagList );
+    timer.Set( abiTagList.size() * abifTAGSIZE, abiTagList.size() );
+
 #ifdef _DEBUG
     // print out the tag records
-    for ( list<AbiTagRecord>::iterator tag = abiTagList.begin();
+    for ( vector<AbiTagRecord>::iterator tag = abiTagList.begin();
         !( tag == abiTagList.end() ); ++tag )
     {
         cout << ( *tag ).GetFlagName() << ": ";
@@ -100,38 +486,65 @@ bool AbiFile::LoadFile(
 }
 
 /*
- * export GeneScan analyzed data
+ * a view over a 16-bit array; DATA 1-4 are the raw channels, 5-8 the
+ * electrophoresis status and 9-12 the analyzed channels
 */
-list<SIGNAL>& AbiFile::GetGSData(
-    list<SIGNAL>& _data )
+AbiShortView AbiFile::GetShortView(
+    const unsigned int _code, const int _fid )
 {
-    string szCAPTION[] = { "Filter 1", "Filter 2", "Filter 3", "Filter 4" };
-    list<AbiTagRecord>::iterator tag;
-    SIGNAL stData;
+    vector<AbiTagRecord>::iterator tag = FindFlag( _code, _fid );
 
-    // loop through index 9, 10, 11, 12
-    for ( int i = 0; i < 4; ++i )
+    if ( tag == abiTagList.end() ||
+        !Require( ( *tag ).GetDataValue(), ( *tag ).GetRecordCount(), abiSHORT ) )
     {
-        tag = FindFlag( "DATA", ( i + 9 ) );
+        return( AbiShortView() );
+    }
 
-        if ( tag == abiTagList.end() )
+    return( AbiShortView( szAbifBuffer + ( *tag ).GetDataValue(), ( *tag ).GetRecordCount() ) );
+}
+
+/*
+ * the channels DATA _first to _first + 3, each one that is in the file gets
+ * a signal in the list, decoded when the plan is extracted
+*/
+pmr::list<SIGNAL>& AbiFile::GetSignal(
+    pmr::list<SIGNAL>& _data, AbiPlan& _plan, const string* _caption, int _first )
+{
+    for ( int i = 0; i < 4; ++i )
+    {
+        if ( FindFlag( abiFLAGDATA, ( i + _first ) ) == abiTagList.end() )
         {
             continue;
         }
 
-        stData.szCaption = szCAPTION[ i ];
-        GetShort( tag, stData.vSignal );
+        // built in place, so it takes the memory resource of the list
+        _data.emplace_back();
+        _data.back().szCaption = _caption[ i ];
+        _data.back().nFlagID = i + _first;
+        _plan.AddShort( abiFLAGDATA, ( i + _first ), _data.back().vSignal );
+    }
 
-#ifdef _DEBUG
-        cout << stData.szCaption << ": " << stData.vSignal.size() << endl;
-#endif
+    return( _data );
+}
 
-        _data.push_back( stData );
-    }
+/*
+ * export GeneScan analyzed data
+*/
+pmr::list<SIGNAL>& AbiFile::GetGSData(
+    pmr::list<SIGNAL>& _data, AbiPlan& _plan )
+{
+    string szCAPTION[] = { "Filter 1", "Filter 2", "Filter 3", "Filter 4" };
 
-#ifdef _DEBUG
-    cout << "record: " << _data.size() << endl;
-#endif
+    // loop through index 9, 10, 11, 12
+    return( GetSignal( _data, _plan, szCAPTION, 9 ) );
+}
+
+pmr::list<SIGNAL>& AbiFile::GetGSData(
+    pmr::list<SIGNAL>& _data )
+{
+    abiPlan.Clear();
+    GetGSData( _data, abiPlan );
+    Extract( abiPlan );
 
     return( _data );
 }
@@ -139,138 +552,255 @@ list<SIGNAL>& AbiFile::GetGSData(
 /*
  * export the CCD raw data
 */
-list<SIGNAL>& AbiFile::GetCCDData(
-    list<SIGNAL>& _data )
+pmr::list<SIGNAL>& AbiFile::GetCCDData(
+    pmr::list<SIGNAL>& _data, AbiPlan& _plan )
 {
     string szCAPTION[] = { "Filter 1", "Filter 2", "Filter 3", "Filter 4" };
-    list<AbiTagRecord>::iterator tag;
-    SIGNAL stData;
 
     // loop through index 1, 2, 3, 4
-    for ( int i = 0; i < 4; ++i )
-    {
-        tag = FindFlag( "DATA", ( i + 1 ) );
+    return( GetSignal( _data, _plan, szCAPTION, 1 ) );
+}
 
-        if ( tag == abiTagList.end() )
-        {
-            continue;
-        }
+pmr::list<SIGNAL>& AbiFile::GetCCDData(
+    pmr::list<SIGNAL>& _data )
+{
+    abiPlan.Clear();
+    GetCCDData( _data, abiPlan );
+    Extract( abiPlan );
 
-        stData.szCaption = szCAPTION[ i ];
-        stData.vSignal.clear();
-        GetShort( tag, stData.vSignal );
+    return( _data );
+}
 
-#ifdef _DEBUG
-        cout << stData.szCaption << ": " << stData.vSignal.size() << endl;
-#endif
+/*
+ * export electrophoresis status
+*/
+pmr::list<SIGNAL>& AbiFile::GetEPData(
+    pmr::list<SIGNAL>& _data, AbiPlan& _plan )
+{
+    string szCAPTION[] = { "Voltage", "mAmps", "Watts", "Temperature" };
 
-        _data.push_back( stData );
-    }
+    // loop through index 5, 6, 7, 8
+    return( GetSignal( _data, _plan, szCAPTION, 5 ) );
+}
 
-#ifdef _DEBUG
-    cout << "record: " << _data.size() << endl;
-#endif
+pmr::list<SIGNAL>& AbiFile::GetEPData(
+    pmr::list<SIGNAL>& _data )
+{
+    abiPlan.Clear();
+    GetEPData( _data, abiPlan );
+    Extract( abiPlan );
 
     return( _data );
 }
 
 /*
- * export electrophoresis status
+ * export peak record
 */
-list<SIGNAL>& AbiFile::GetEPData(
-    list<SIGNAL>& _data )
+list<PEAK>& AbiFile::GetPeakData(
+    list<PEAK>& _data, AbiPlan& _plan )
 {
-    string szCAPTION[] = { "Voltage", "mAmps", "Watts", "Temperature" };
-    list<AbiTagRecord>::iterator tag;
-    SIGNAL stData;
+    string szCAPTION[] = { "Filter 1", "Filter 2", "Filter 3", "Filter 4" };
+    vector<AbiTagRecord>::iterator tag;
+    PEAK stPeak;
+    int count;
 
-    // loop through index 5, 6, 7, 8
     for ( int i = 0; i < 4; ++i )
     {
-        tag = FindFlag( "DATA", ( i + 5 ) );
+        // locate the peak record
+        tag = FindFlag( abiFLAGPKNUM, ( i + 1 ) );
 
         if ( tag == abiTagList.end() )
         {
             continue;
         }
 
-        stData.szCaption = szCAPTION[ i ];
-        stData.vSignal.clear();
-        GetShort( tag, stData.vSignal );
+        // get the number of records
+        count = GetShort( tag );
 
-#ifdef _DEBUG
-        cout << stData.szCaption << ": " << stData.vSignal.size() << endl;
-#endif
+        if ( !( count > 0 ) || FindFlag( abiFLAGPEAK, ( i + 1 ) ) == abiTagList.end() )
+        {
+            continue;
+        }
 
-        _data.push_back( stData );
+        stPeak.szCaption = szCAPTION[ i ];
+        _data.push_back( stPeak );
+        _plan.AddPeak( ( i + 1 ), count, _data.back().lpPeak );
     }
 
-#ifdef _DEBUG
-    cout << "record: " << _data.size() << endl;
-#endif
+    return( _data );
+}   // end of GetPeakData()
+
+list<PEAK>& AbiFile::GetPeakData(
+    list<PEAK>& _data )
+{
+    abiPlan.Clear();
+    GetPeakData( _data, abiPlan );
+    Extract( abiPlan );
 
     return( _data );
 }
 
 /*
- * export peak record
+ * export the peak records as one table per filter; the tables of a previous
+ * file are reused, so their arrays keep their capacity
 */
-list<PEAK>& AbiFile::GetPeakData(
-    list<PEAK>& _data )
+vector<PEAKTABLE>& AbiFile::GetPeakTable(
+    vector<PEAKTABLE>& _data, AbiPlan& _plan )
 {
     string szCAPTION[] = { "Filter 1", "Filter 2", "Filter 3", "Filter 4" };
-    list<AbiTagRecord>::iterator tag;
-    PEAK stPeak;
-    int count;
+    vector<AbiTagRecord>::iterator tag;
+    int fid[ 4 ], count[ 4 ], n = 0;
 
     for ( int i = 0; i < 4; ++i )
     {
-        // locate the peak record
-        tag = FindFlag( "PK_#", ( i + 1 ) );
+        tag = FindFlag( abiFLAGPKNUM, ( i + 1 ) );
 
         if ( tag == abiTagList.end() )
         {
             continue;
         }
 
-        // get the number of records
-        count = GetShort( tag );
+        count[ n ] = GetShort( tag );
 
-        if ( !( count > 0 ) )
+        if ( !( count[ n ] > 0 ) || FindFlag( abiFLAGPEAK, ( i + 1 ) ) == abiTagList.end() )
         {
             continue;
         }
 
-        tag = FindFlag( "PEAK", ( i + 1 ) );
-        stPeak.szCaption = szCAPTION[ i ];
-        stPeak.lpPeak.clear();
-        GetPeakRecord( tag, stPeak.lpPeak, count );
+        fid[ n++ ] = i + 1;
+    }
 
-#ifdef _DEBUG
-        cout << stPeak.szCaption << ": " << stPeak.lpPeak.size() << endl;
-#endif
+    // the plan holds pointers to the tables, so they must not move afterwards
+    _data.resize( n );
 
-        _data.push_back( stPeak );
+    for ( int i = 0; i < n; ++i )
+    {
+        _data[ i ].szCaption = szCAPTION[ fid[ i ] - 1 ];
+        _data[ i ].nCount = 0;
+        _plan.AddPeak( fid[ i ], count[ i ], _data[ i ] );
     }
 
-#ifdef _DEBUG
-    cout << "record: " << _data.size() << endl;
-#endif
+    return( _data );
+}   // end of GetPeakTable()
+
+vector<PEAKTABLE>& AbiFile::GetPeakTable(
+    vector<PEAKTABLE>& _data )
+{
+    abiPlan.Clear();
+    GetPeakTable( _data, abiPlan );
+    Extract( abiPlan );
 
     return( _data );
-}   // end of GetPeakData()
+}
+
+/*
+ * look up every tag of the plan, then decode them in file order; in the lazy
+ * mode all of them are read first, in as few reads as possible. false if a
+ * tag is missing, the others are still decoded
+*/
+bool AbiFile::Extract(
+    AbiPlan& _plan )
+{
+    vector<ABIPLANITEM>& item = _plan.vItem;
+    vector<int>& order = _plan.vOrder;
+    bool found = true;
+
+    order.clear();
+
+    for ( size_t i = 0; i < item.size(); ++i )
+    {
+        item[ i ].nIndex = abiTagIndex.FindIndex( item[ i ].nFlagCode, item[ i ].nFlagID );
+
+        if ( item[ i ].nIndex < 0 )
+        {
+            found = false; continue;
+        }
+
+        order.push_back( static_cast<int>( i ) );
+
+        if ( !( nAbifFile < 0 ) )
+        {
+            AddRange( abiTagList.begin() + item[ i ].nIndex );
+        }
+    }
+
+    {
+        // the reads of the lazy mode are part of loading the file
+        AbiTimer timer( ( nAbifFile < 0 ) ? NULL : pStats, abiSTAGE_LOAD );
+        size_t read = nBytesRead;
+
+        Fetch();
+        timer.Set( nBytesRead - read, 0 );
+    }
+
+    AbiTimer timer( pStats, abiSTAGE_DECODE );
+
+    sort( order.begin(), order.end(), [ & ]( int a, int b )
+    {
+        return( static_cast<unsigned int>( abiTagList[ item[ a ].nIndex ].GetDataValue() ) <
+            static_cast<unsigned int>( abiTagList[ item[ b ].nIndex ].GetDataValue() ) );
+    } );
+
+    for ( vector<int>::iterator i = order.begin(); !( i == order.end() ); ++i )
+    {
+        ABIPLANITEM& p = item[ *i ];
+        vector<AbiTagRecord>::iterator tag = abiTagList.begin() + p.nIndex;
+
+        timer.Add( static_cast<uint64_t>( ( *tag ).GetRecordCount() ) * ( *tag ).GetRecordSize(),
+            ( *tag ).GetRecordCount() );
+
+        switch ( p.nType )
+        {
+        case abiPLAN_SHORT:
+            GetShort( tag, *static_cast<pmr::vector<int>*>( p.pTarget ) );
+            break;
+
+        case abiPLAN_LONG:
+            GetLong( tag, *static_cast<pmr::vector<int>*>( p.pTarget ) );
+            break;
+
+        case abiPLAN_FLOAT:
+            GetFloat( tag, *static_cast<pmr::vector<double>*>( p.pTarget ) );
+            break;
+
+        case abiPLAN_STRING:
+            GetString( tag, *static_cast<string*>( p.pTarget ) );
+            break;
+
+        case abiPLAN_TEXT:
+            GetText( tag, *static_cast<string*>( p.pTarget ) );
+            break;
+
+        case abiPLAN_PEAK:
+            static_cast<list<PEAKDATA>*>( p.pTarget )->clear();
+            GetPeakRecord( tag, *static_cast<list<PEAKDATA>*>( p.pTarget ), p.nCount );
+            break;
+
+        case abiPLAN_PEAKTABLE:
+            GetPeakRecord( tag, *static_cast<PEAKTABLE*>( p.pTarget ), p.nCount );
+            break;
+        }
+    }
+
+    return( found );
+}   // end of Extract()
 
 /*
  * extract the peak data from the file
 */
 list<PEAKDATA>& AbiFile::GetPeakRecord(
-    list<AbiTagRecord>::iterator _tag,
+    vector<AbiTagRecord>::iterator _tag,
     list<PEAKDATA>& _data,
     int _count )
 {
     int entry = ( *_tag ).GetDataValue();
     PEAKDATA stPeakData;
 
+    if ( !Require( entry, _count, abifPEAKSIZE ) )
+    {
+        return( _data );
+    }
+
     for ( int i = 0; i < _count; ++i )
     {
         stPeakData.nPoint = GetLong( entry );       entry += abiLONG;
@@ -290,24 +820,108 @@ list<PEAKDATA>& AbiFile::GetPeakRecord(
     return( _data );
 }   // end of GetPeakRecord()
 
+/*
+ * decode the peak records straight into the columns of the table
+*/
+PEAKTABLE& AbiFile::GetPeakRecord(
+    vector<AbiTagRecord>::iterator _tag,
+    PEAKTABLE& _data,
+    int _count )
+{
+    int entry = ( *_tag ).GetDataValue();
+
+    _data.nCount = Require( entry, _count, abifPEAKSIZE ) ? _count : 0;
+
+    _data.vPosition.resize( _data.nCount ); _data.vHeight.resize( _data.nCount );
+    _data.vBegin.resize( _data.nCount ); _data.vEnd.resize( _data.nCount );
+    _data.vBeginHi.resize( _data.nCount ); _data.vEndHi.resize( _data.nCount );
+    _data.vArea.resize( _data.nCount ); _data.vVolume.resize( _data.nCount );
+    _data.vSize.resize( _data.nCount ); _data.vEdit.resize( _data.nCount );
+    _data.vLabel.resize( static_cast<size_t>( _data.nCount ) * abifLABELSIZE );
+
+    if ( _data.nCount > 0 )
+    {
+        ABIPEAKCOLUMN column = { _data.vPosition.data(), _data.vHeight.data(),
+            _data.vBegin.data(), _data.vEnd.data(), _data.vBeginHi.data(),
+            _data.vEndHi.data(), _data.vArea.data(), _data.vVolume.data(),
+            _data.vSize.data(), _data.vEdit.data(), _data.vLabel.data() };
+
+        AbiDecodePeak( szAbifBuffer + entry, column, _data.nCount );
+    }
+
+    return( _data );
+}   // end of GetPeakRecord()
+
 /*
  * find the tag record with a specified flag name and id
 */
-list<AbiTagRecord>::iterator AbiFile::FindFlag(
+vector<AbiTagRecord>::iterator AbiFile::FindFlag(
    const string& _flag, const int _fid )
 {
-    list<AbiTagRecord>::iterator i;
+    return( FindFlag( AbiFlagCode( _flag ), _fid ) );
+}   // end of FindFlag()
 
-    for ( i = abiTagList.begin(); !( i == abiTagList.end() ); ++i )
+vector<AbiTagRecord>::iterator AbiFile::FindFlag(
+   const unsigned int _code, const int _fid )
+{
+    int i = abiTagIndex.FindIndex( _code, _fid );
+
+    // the index is built when the file is loaded
+    return( ( i < 0 ) ? abiTagList.end() : abiTagList.begin() + i );
+}   // end of FindFlag()
+
+/*
+ * copy the tag directory
+*/
+list<AbiTagRecord>& AbiFile::GetTagRecord(
+    list<AbiTagRecord>& _list ) const
+{
+    _list.insert( _list.end(), abiTagList.begin(), abiTagList.end() );
+
+    return( _list );
+}
+
+/*
+ * check that an array of _count elements at _entry lies within the file
+*/
+bool AbiFile::IsInFile(
+    int _entry, int _count, int _size ) const
+{
+    return( !( _entry < 0 ) && !( _count < 0 ) &&
+        !( static_cast<size_t>( _entry ) + static_cast<size_t>( _count ) * _size > nAbifSize ) );
+}
+
+/*
+ * like IsInFile, and in the lazy mode also read the array if it is not in yet
+*/
+bool AbiFile::Require(
+    int _entry, int _count, int _size )
+{
+    if ( !IsInFile( _entry, _count, _size ) )
+    {
+        return( false );
+    }
+
+    if ( nAbifFile < 0 )
     {
-        if ( ( ( *i ).GetFlagName() == _flag ) && ( ( *i ).GetFlagID() == _fid ) )
+        return( true );
+    }
+
+    ABIRANGE range = { static_cast<size_t>( _entry ),
+        static_cast<size_t>( _entry ) + static_cast<size_t>( _count ) * _size };
+
+    for ( vector<ABIRANGE>::iterator i = vAbifLoaded.begin(); !( i == vAbifLoaded.end() ); ++i )
+    {
+        if ( !( ( *i ).nBegin > range.nBegin ) && !( ( *i ).nEnd < range.nEnd ) )
         {
-            return( i );
+            return( true );
         }
-    }   // search the entire list for the given flag and file identification
+    }
 
-    return( abiTagList.end() );
-}   // end of FindFlag()
+    vAbifRequest.push_back( range );
+
+    return( Fetch() );
+}
 
 /*
  * get a character from the file
@@ -319,17 +933,22 @@ char AbiFile::GetChar(
 }
 
 char AbiFile::GetChar(
-    list<AbiTagRecord>::iterator _i )
+    vector<AbiTagRecord>::iterator _i )
 {
     return( static_cast<char>( ( ( *_i ).GetDataValue() >> 0x18 ) & 0xFF ) );
 }
 
 vector<char>& AbiFile::GetChar(
-    list<AbiTagRecord>::iterator _i, vector<char>& _v )
+    vector<AbiTagRecord>::iterator _i, vector<char>& _v )
 {
     int entry = ( *_i ).GetDataValue();
     _v.clear();
 
+    if ( !Require( entry, ( *_i ).GetRecordCount(), 1 ) )
+    {
+        return( _v );
+    }
+
     for ( int i = 0; i < ( *_i ).GetRecordCount(); ++i, ++entry )
     {
         _v.push_back( szAbifBuffer[ entry ] );
@@ -359,7 +978,7 @@ int AbiFile::GetShort(
 }
 
 int AbiFile::GetShort(
-    list<AbiTagRecord>::iterator _i )
+    vector<AbiTagRecord>::iterator _i )
 {
     // only return the first two bytes
     return( ( *_i ).GetDataValue() >> 0x10 );
@@ -368,18 +987,17 @@ int AbiFile::GetShort(
 /*
  * extract all the data from the file
 */
-vector<int>& AbiFile::GetShort(
-    list<AbiTagRecord>::iterator _i, vector<int>& _v )
+pmr::vector<int>& AbiFile::GetShort(
+    vector<AbiTagRecord>::iterator _i, pmr::vector<int>& _v )
 {
     int entry = ( *_i ).GetDataValue();
-    int value;
+    int count = ( *_i ).GetRecordCount();
     _v.clear();     // clear all elements
 
-    for ( int i = 0; i < ( *_i ).GetRecordCount(); ++i )
+    if ( Require( entry, count, abiSHORT ) )
     {
-        value  = szAbifBuffer[ entry++ ] << 0x8;
-        value += szAbifBuffer[ entry++ ];
-        _v.push_back( value );
+        _v.resize( count );
+        AbiDecodeShort( szAbifBuffer + entry, _v.data(), count );
     }
 
     return( _v );
@@ -402,25 +1020,22 @@ int AbiFile::GetLong(
 }
 
 int AbiFile::GetLong(
-    list<AbiTagRecord>::iterator _i )
+    vector<AbiTagRecord>::iterator _i )
 {
     return( ( *_i ).GetDataValue() );
 }
 
-vector<int>& AbiFile::GetLong(
-    list<AbiTagRecord>::iterator _i, vector<int>& _v )
+pmr::vector<int>& AbiFile::GetLong(
+    vector<AbiTagRecord>::iterator _i, pmr::vector<int>& _v )
 {
     int entry = ( *_i ).GetDataValue();
-    int value;
+    int count = ( *_i ).GetRecordCount();
     _v.clear();     // clear all elements
 
-    for ( int i = 0; i < ( *_i ).GetRecordCount(); ++i )
+    if ( Require( entry, count, abiLONG ) )
     {
-        value  = szAbifBuffer[ entry++ ] << 0x18;
-        value += szAbifBuffer[ entry++ ] << 0x10;
-        value += szAbifBuffer[ entry++ ] << 0x8;
-        value += szAbifBuffer[ entry++ ];
-        _v.push_back( value );
+        _v.resize( count );
+        AbiDecodeLong( szAbifBuffer + entry, _v.data(), count );
     }
 
     return( _v );
@@ -461,24 +1076,22 @@ double AbiFile::GetFloat(
 }
 
 double AbiFile::GetFloat(
-    list<AbiTagRecord>::iterator _i )
+    vector<AbiTagRecord>::iterator _i )
 {
     return( ReadFloat( static_cast<unsigned int>( ( *_i ).GetDataValue() ) ) );
 }
 
-vector<double>& AbiFile::GetFloat(
-    list<AbiTagRecord>::iterator _i, vector<double>& _v )
+pmr::vector<double>& AbiFile::GetFloat(
+    vector<AbiTagRecord>::iterator _i, pmr::vector<double>& _v )
 {
     int entry = ( *_i ).GetDataValue();
-    unsigned int value;
+    int count = ( *_i ).GetRecordCount();
+    _v.clear();     // clear all elements
 
-    for ( int i = 0; i < ( *_i ).GetRecordCount(); ++i )
+    if ( Require( entry, count, abiFLOAT ) )
     {
-        value  = szAbifBuffer[ entry++ ] << 0x18;
-        value += szAbifBuffer[ entry++ ] << 0x10;
-        value += szAbifBuffer[ entry++ ] << 0x8;
-        value += szAbifBuffer[ entry++ ];
-        _v.push_back( ReadFloat( value ) );
+        _v.resize( count );
+        AbiDecodeFloat( szAbifBuffer + entry, _v.data(), count );
     }
 
     return( _v );
@@ -488,7 +1101,7 @@ vector<double>& AbiFile::GetFloat(
  * get the date information from the file in string format
 */
 string& AbiFile::GetDate(
-    list<AbiTagRecord>::iterator _i, string& _s )
+    vector<AbiTagRecord>::iterator _i, string& _s )
 {
     int value = ( *_i ).GetDataValue();
     int year = ( value >> 0x10 ) & 0xFFFF;  // byte[1][2]: year
@@ -506,7 +1119,7 @@ string& AbiFile::GetDate(
  * time: byte[1][2][3][4]=hh:mm:ss:tt
 */
 double AbiFile::GetTime(
-    list<AbiTagRecord>::iterator _i )
+    vector<AbiTagRecord>::iterator _i )
 {
     int value = ( *_i ).GetDataValue();
     double tt = ( value & 0xFF ) / 1000.0;          // byte[4]: one thousandth
@@ -522,7 +1135,7 @@ double AbiFile::GetTime(
  * get the time information from the file in string format
 */
 string& AbiFile::GetTime(
-    list<AbiTagRecord>::iterator _i, string& _s )
+    vector<AbiTagRecord>::iterator _i, string& _s )
 {
     int value = ( *_i ).GetDataValue();
     int tt = ( value & 0xFF );              // byte[0]: one thousandth
@@ -544,18 +1157,16 @@ string& AbiFile::GetTime(
 string& AbiFile::GetString(
     int _entry, int _size, string& _s )
 {
-    _s.resize( _size );
+    const char* p = reinterpret_cast<const char*>( szAbifBuffer + _entry );
 
-    for ( int i = 0; i < _size; ++i, ++_entry )
-    {
-        _s[ 0 ] = szAbifBuffer[ _entry ];
-    }
+    // fixed width fields are padded with nulls
+    _s.assign( p, strnlen( p, _size ) );
 
     return( _s );
 }
 
 string& AbiFile::GetString(
-    list<AbiTagRecord>::iterator _i, string& _s )
+    vector<AbiTagRecord>::iterator _i, string& _s )
 {
    int entry = ( *_i ).GetDataValue();
     int length = ( *_i ).GetRecordSize();
@@ -563,6 +1174,11 @@ string& AbiFile::GetString(
 
     if ( length > 4 )
     {
+        if ( !Require( entry, length + 1, 1 ) )
+        {
+            _s.clear(); return( _s );
+        }
+
         for ( int i = 0; i < length; ++i )
         {
             _s[ i ] = szAbifBuffer[ ++entry ];  // first byte is the length
@@ -579,6 +1195,143 @@ string& AbiFile::GetString(
     return( _s );
 }
 
+/*
+ * a tag as text: strings as they are, numbers in decimal, dates as yyyy-mm-dd
+ * and times as hh:mm:ss.tt; arrays are separated by commas. false for the
+ * types that have no text form, e.g. the peak records
+*/
+bool AbiFile::GetText(
+    const unsigned int _code, const int _fid, string& _s )
+{
+    vector<AbiTagRecord>::iterator tag = FindFlag( _code, _fid );
+
+    if ( tag == abiTagList.end() )
+    {
+        _s.clear(); return( false );
+    }
+
+    return( GetText( tag, _s ) );
+}
+
+bool AbiFile::GetText(
+    vector<AbiTagRecord>::iterator _i, string& _s )
+{
+    int entry = ( *_i ).GetDataValue();
+    int count = ( *_i ).GetRecordCount();
+    int size = ( *_i ).GetRecordSize();
+    unsigned char value[ 4 ];
+    const unsigned char* p = value;
+    char sz_value[ 32 ];
+
+    _s.clear();
+
+    if ( count < 0 || !( size > 0 ) )
+    {
+        return( false );
+    }
+
+    size_t length = static_cast<size_t>( count ) * size;
+
+    // four bytes or less are kept in the data value field itself
+    if ( length > 4 )
+    {
+        if ( !Require( entry, count, size ) )
+        {
+            return( false );
+        }
+
+        p = szAbifBuffer + entry;
+    }
+    else
+    {
+        value[ 0 ] = ( entry >> 0x18 ) & 0xFF; value[ 1 ] = ( entry >> 0x10 ) & 0xFF;
+        value[ 2 ] = ( entry >> 0x8 ) & 0xFF; value[ 3 ] = entry & 0xFF;
+    }
+
+    switch ( ( *_i ).GetDataType() )
+    {
+    case abiTYPE_PSTRING:
+        // the first byte is the length
+        if ( length > 0 )
+        {
+            _s.assign( reinterpret_cast<const char*>( p + 1 ), min<size_t>( p[ 0 ], length - 1 ) );
+        }
+
+        return( true );
+
+    case abiTYPE_CHAR:
+    case abiTYPE_CSTRING:
+        _s.assign( reinterpret_cast<const char*>( p ), strnlen( reinterpret_cast<const char*>( p ), length ) );
+        return( true );
+
+    case abiTYPE_BYTE:
+    case abiTYPE_BOOLEAN:
+    case abiTYPE_WORD:
+    case abiTYPE_SHORT:
+    case abiTYPE_LONG:
+    case abiTYPE_FLOAT:
+    case abiTYPE_DOUBLE:
+    case abiTYPE_DATE:
+    case abiTYPE_TIME:
+        break;
+
+    default:
+        return( false );
+    }
+
+    for ( int i = 0; i < count; ++i, p += size )
+    {
+        unsigned long long wide = 0;
+
+        for ( int k = 0; k < size; ++k )
+        {
+            wide = ( wide << 0x8 ) | p[ k ];
+        }
+
+        unsigned int bits = static_cast<unsigned int>( wide );
+
+        switch ( ( *_i ).GetDataType() )
+        {
+        case abiTYPE_SHORT:
+            snprintf( sz_value, sizeof( sz_value ), "%d", static_cast<int16_t>( bits ) );
+            break;
+
+        case abiTYPE_LONG:
+            snprintf( sz_value, sizeof( sz_value ), "%d", static_cast<int32_t>( bits ) );
+            break;
+
+        case abiTYPE_FLOAT:
+            snprintf( sz_value, sizeof( sz_value ), "%g", ReadFloat( bits ) );
+            break;
+
+        case abiTYPE_DOUBLE:
+        {
+            double real;
+            memcpy( &real, &wide, sizeof( real ) );
+            snprintf( sz_value, sizeof( sz_value ), "%g", real );
+            break;
+        }
+
+        case abiTYPE_DATE:
+            snprintf( sz_value, sizeof( sz_value ), "%04u-%02u-%02u",
+                ( bits >> 0x10 ) & 0xFFFF, ( bits >> 0x8 ) & 0xFF, bits & 0xFF );
+            break;
+
+        case abiTYPE_TIME:
+            snprintf( sz_value, sizeof( sz_value ), "%02u:%02u:%02u.%02u",
+                ( bits >> 0x18 ) & 0xFF, ( bits >> 0x10 ) & 0xFF, ( bits >> 0x8 ) & 0xFF, bits & 0xFF );
+            break;
+
+        default:    // byte, boolean and word are unsigned
+            snprintf( sz_value, sizeof( sz_value ), "%u", bits );
+        }
+
+        _s.append( ( i > 0 ) ? "," : "" ).append( sz_value );
+    }
+
+    return( true );
+}   // end of GetText()
+
 /*
  * test driver program
 */
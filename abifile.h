@@ -14,7 +14,10 @@
 #ifndef _ABI_FILE_H
 #define _ABI_FILE_H
 
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 // C++ header files
 #include <list>
@@ -24,12 +27,18 @@
 #include <fstream>
 #include <cstring>
 #include <iostream>
+#include <memory_resource>
+
+#include <abiview.h>
+#include <abiindex.h>
+#include <abistats.h>
 
 //#define _DEBUG
 
 using namespace std;
 
 const int abifTAGSIZE   = 28;
+const int abifHEADERSIZE = 128;
 const int sizeFLOAT     = sizeof( float );
 const int sizeDOUBLE    = sizeof( double );
 const int sizeLDOUBLE   = sizeof( long double );
@@ -39,6 +48,15 @@ const int abiSHORT      = 2;
 const int abiLONG       = 4;
 const int abiFLOAT      = 4;
 const int abiBOOL       = 2;
+const int abifPEAKSIZE  = 96;
+const int abifLABELSIZE = 64;
+const int abifCOALESCE  = 4096;     // gap read through rather than split a read
+
+// flags looked up by the export functions
+const unsigned int abiFLAGDATA  = ABI_FLAG( 'D', 'A', 'T', 'A' );
+const unsigned int abiFLAGPEAK  = ABI_FLAG( 'P', 'E', 'A', 'K' );
+const unsigned int abiFLAGPKNUM = ABI_FLAG( 'P', 'K', '_', '#' );
+const unsigned int abiFLAGMTRX  = ABI_FLAG( 'M', 'T', 'R', 'X' );
 
 // a total of 96 bytes
 struct PEAKDATA
@@ -56,10 +74,28 @@ struct PEAKDATA
     string szLabel; // peak label; 64 bytes
 };
 
+/*
+ * allocator aware, so a pmr::list of signals puts the captions and the
+ * samples on the same memory resource as the list, e.g. an AbiArena
+*/
 struct SIGNAL
 {
-    string szCaption;       // signal caption
-    vector<int> vSignal;    // relative fluorescent intensity
+    typedef pmr::polymorphic_allocator<char> allocator_type;
+
+    pmr::string szCaption;      // signal caption
+    pmr::vector<int> vSignal;   // relative fluorescent intensity
+    int nFlagID;                // DATA id the samples were read from; 0 if computed
+
+    SIGNAL() : nFlagID( 0 ) {}
+    explicit SIGNAL( const allocator_type& _a ) : szCaption( _a ), vSignal( _a ), nFlagID( 0 ) {}
+    SIGNAL( const SIGNAL& _s ) = default;
+    SIGNAL( const SIGNAL& _s, const allocator_type& _a ) :
+        szCaption( _s.szCaption, _a ), vSignal( _s.vSignal, _a ), nFlagID( _s.nFlagID ) {}
+    SIGNAL( SIGNAL&& _s ) = default;
+    SIGNAL( SIGNAL&& _s, const allocator_type& _a ) :
+        szCaption( move( _s.szCaption ), _a ), vSignal( move( _s.vSignal ), _a ), nFlagID( _s.nFlagID ) {}
+    SIGNAL& operator=( const SIGNAL& _s ) = default;
+    SIGNAL& operator=( SIGNAL&& _s ) = default;
 };
 
 struct PEAK
@@ -68,6 +104,131 @@ struct PEAK
     list<PEAKDATA> lpPeak;
 };
 
+/*
+ * the peak records of a filter as one array per field; the labels are kept
+ * back to back, abifLABELSIZE bytes each and padded with nulls
+*/
+struct PEAKTABLE
+{
+    string szCaption;
+    int nCount;                 // number of peaks
+    vector<int32_t> vPosition;
+    vector<int32_t> vHeight;
+    vector<int32_t> vBegin;
+    vector<int32_t> vEnd;
+    vector<int32_t> vBeginHi;
+    vector<int32_t> vEndHi;
+    vector<int32_t> vArea;
+    vector<int32_t> vVolume;
+    vector<float> vSize;
+    vector<uint8_t> vEdit;
+    vector<char> vLabel;
+
+    const char* GetLabel( int _i ) const    { return( &vLabel[ _i * abifLABELSIZE ] ); }
+};
+
+/*
+ * how the tracefile is brought into memory; a mapped file falls back to the
+ * buffered read if the file system does not support mmap
+*/
+enum AbiLoadMode
+{
+    abiMAPPED,      // read-only memory mapping of the file
+    abiBUFFERED,    // private heap copy of the file
+    abiLAZY         // header and directory only; tags are read when used
+};
+
+/*
+ * why the last load failed; a failed load leaves the object empty and ready
+ * for the next file
+*/
+enum AbiError
+{
+    abiERROR_NONE,
+    abiERROR_OPEN,          // the file cannot be opened or its size read
+    abiERROR_READ,          // the file cannot be mapped or read to the end
+    abiERROR_SIZE,          // too short to hold the header
+    abiERROR_SIGNATURE,     // not an ABIF file
+    abiERROR_DIRECTORY      // the tag directory lies outside the file
+};
+
+/*
+ * a byte range [nBegin, nEnd) of the tracefile
+*/
+struct ABIRANGE
+{
+    size_t nBegin;
+    size_t nEnd;
+};
+
+/*
+ * what an extraction plan decodes a tag into
+*/
+enum AbiPlanType
+{
+    abiPLAN_SHORT,      // pmr::vector<int>
+    abiPLAN_LONG,       // pmr::vector<int>
+    abiPLAN_FLOAT,      // pmr::vector<double>
+    abiPLAN_STRING,     // string
+    abiPLAN_TEXT,       // string; any scalar tag, see AbiFile::GetText
+    abiPLAN_PEAK,       // list<PEAKDATA>
+    abiPLAN_PEAKTABLE   // PEAKTABLE
+};
+
+struct ABIPLANITEM
+{
+    unsigned int nFlagCode;
+    int nFlagID;
+    AbiPlanType nType;
+    void* pTarget;      // caller's storage
+    int nCount;         // number of peak records
+    int nIndex;         // tag record; -1 if the file does not have it
+};
+
+/*
+ * the tags a caller needs from a file, declared up front. AbiFile::Extract
+ * looks them all up at once and decodes them in the order they are stored
+ * in the file rather than the order they were asked for. the storage must
+ * stay put until the plan has been extracted
+*/
+class AbiPlan
+{
+public:
+    void Clear()    { vItem.clear(); }
+
+    int AddShort( const unsigned int _code, const int _fid, pmr::vector<int>& _v )
+        { return( Add( _code, _fid, abiPLAN_SHORT, &_v, 0 ) ); }
+    int AddLong( const unsigned int _code, const int _fid, pmr::vector<int>& _v )
+        { return( Add( _code, _fid, abiPLAN_LONG, &_v, 0 ) ); }
+    int AddFloat( const unsigned int _code, const int _fid, pmr::vector<double>& _v )
+        { return( Add( _code, _fid, abiPLAN_FLOAT, &_v, 0 ) ); }
+    int AddString( const unsigned int _code, const int _fid, string& _s )
+        { return( Add( _code, _fid, abiPLAN_STRING, &_s, 0 ) ); }
+    int AddText( const unsigned int _code, const int _fid, string& _s )
+        { return( Add( _code, _fid, abiPLAN_TEXT, &_s, 0 ) ); }
+    int AddPeak( const int _fid, const int _count, list<PEAKDATA>& _l )
+        { return( Add( abiFLAGPEAK, _fid, abiPLAN_PEAK, &_l, _count ) ); }
+    int AddPeak( const int _fid, const int _count, PEAKTABLE& _t )
+        { return( Add( abiFLAGPEAK, _fid, abiPLAN_PEAKTABLE, &_t, _count ) ); }
+
+    int GetCount() const            { return( static_cast<int>( vItem.size() ) ); }
+    bool IsFound( int _i ) const    { return( !( vItem[ _i ].nIndex < 0 ) ); }
+
+private:
+    friend class AbiFile;
+
+    vector<ABIPLANITEM> vItem;      // in the order they were declared
+    vector<int>         vOrder;     // found items by file offset
+
+    int Add( const unsigned int _code, const int _fid, AbiPlanType _type, void* _p, int _count )
+    {
+        ABIPLANITEM item = { _code, _fid, _type, _p, _count, -1 };
+        vItem.push_back( item );
+
+        return( GetCount() - 1 );
+    }
+};
+
 /*
  * class implementation to access the ABI tracefile
 */
@@ -77,18 +238,88 @@ public:
     AbiFile();
     AbiFile( const char* );
     AbiFile( string&  );
-    ~AbiFile()  { delete szAbifBuffer; }
+    ~AbiFile();
 
-    bool LoadFile( const char* );
-    list<SIGNAL>&   GetCCDData( list<SIGNAL>& );
-    list<SIGNAL>&   GetGSData( list<SIGNAL>& );
-    list<SIGNAL>&   GetEPData( list<SIGNAL>& );
+    // false on failure, with the reason in GetError; the object can be loaded
+    // again right away and keeps its buffer and directory for the next file
+    bool LoadFile( const char*, AbiLoadMode = abiMAPPED );
+    bool LoadBuffer( unsigned char*, size_t, AbiError = abiERROR_READ, int = 0 );    // the reason if there is no buffer
+    void Reset()    { Release(); nAbifError = abiERROR_NONE; nAbifErrno = 0; }
+
+    bool    IsLoaded() const    { return( !( szAbifBuffer == NULL ) ); }
+    AbiError GetError() const   { return( nAbifError ); }
+    int     GetSystemError() const  { return( nAbifErrno ); }  // errno of the failed call; 0 if none
+    static const char* GetErrorText( AbiError );
+
+    pmr::list<SIGNAL>&   GetCCDData( pmr::list<SIGNAL>& );
+    pmr::list<SIGNAL>&   GetGSData( pmr::list<SIGNAL>& );
+    pmr::list<SIGNAL>&   GetEPData( pmr::list<SIGNAL>& );
     list<PEAK>&     GetPeakData( list<PEAK>& );
+    vector<PEAKTABLE>&  GetPeakTable( vector<PEAKTABLE>& );
+
+    // declare the same tables in a plan; they are filled by Extract
+    pmr::list<SIGNAL>&   GetCCDData( pmr::list<SIGNAL>&, AbiPlan& );
+    pmr::list<SIGNAL>&   GetGSData( pmr::list<SIGNAL>&, AbiPlan& );
+    pmr::list<SIGNAL>&   GetEPData( pmr::list<SIGNAL>&, AbiPlan& );
+    list<PEAK>&     GetPeakData( list<PEAK>&, AbiPlan& );
+    vector<PEAKTABLE>&  GetPeakTable( vector<PEAKTABLE>&, AbiPlan& );
+    bool            Extract( AbiPlan& );
+
+    // a tag in readable form; false if it is missing or has no text form
+    bool    GetText( const unsigned int, const int, string& );
+
     list<AbiTagRecord>& GetTagRecord( list<AbiTagRecord>& ) const;
+    const AbiTagIndex&  GetTagRecord() const    { return( abiTagIndex ); }
+
+    // views straight into the tracefile; empty if the tag is missing
+    AbiShortView    GetShortView( const unsigned int, const int );
+    AbiShortView    GetDataView( const int _fid )   { return( GetShortView( abiFLAGDATA, _fid ) ); }
+
+    // lazy mode: read the payload of ids first-last of a flag in as few reads
+    // as possible; the other modes have the whole file already
+    bool    FetchFlag( const unsigned int, const int, const int );
+    size_t  GetFileSize() const     { return( nAbifSize ); }
+    size_t  GetBytesRead() const    { return( nBytesRead ); }
+    size_t  GetReadCount() const    { return( nReadCount ); }
+
+    // time the loading, parsing and decoding into _s; NULL to stop
+    void    SetStats( AbiStats* _s )    { pStats = _s; }
 
 private:
-    list<AbiTagRecord>  abiTagList;
-    unsigned char*      szAbifBuffer;
+    vector<AbiTagRecord> abiTagList;    // the directory, in file order
+    AbiTagIndex         abiTagIndex;    // flag name and id to tag record
+    const unsigned char* szAbifBuffer;
+    size_t              nAbifSize;      // size of the tracefile (bytes)
+    bool                bAbifMapped;    // buffer is a mapping, not a heap copy
+    int                 nAbifFile;      // kept open in the lazy mode; -1 otherwise
+    size_t              nBytesRead;     // bytes read from the file
+    size_t              nReadCount;     // reads issued for the file
+    vector<ABIRANGE>    vAbifLoaded;    // lazy mode: ranges in the buffer, sorted
+    vector<ABIRANGE>    vAbifRequest;   // lazy mode: ranges for the next fetch
+    AbiPlan             abiPlan;        // for the Get*Data calls without a plan
+    AbiStats*           pStats;         // NULL if not measured
+    unsigned char*      szAbifHeap;     // buffer of the buffered and lazy modes, reused
+    size_t              nAbifHeapSize;
+    AbiError            nAbifError;     // why the last load failed
+    int                 nAbifErrno;
+
+    // the buffer is owned by the object; copies are not allowed
+    AbiFile( const AbiFile& );
+    AbiFile& operator=( const AbiFile& );
+
+    void    Release();
+    bool    Fail( AbiError, int = 0 );
+    unsigned char* GetHeap( size_t );
+    bool    Parse();
+    bool    MapFile( int );
+    bool    ReadFile( int );
+    bool    ReadRange( int, size_t, size_t );
+    bool    LazyFile( int );
+    bool    Fetch();
+    void    AddRange( vector<AbiTagRecord>::iterator );
+    bool    IsInFile( int, int, int ) const;
+    bool    Require( int, int, int );
+    pmr::list<SIGNAL>&   GetSignal( pmr::list<SIGNAL>&, AbiPlan&, const string*, int );
 
     bool    GetBool( int );
     int     GetShort( int );
@@ -96,22 +327,25 @@ private:
     char    GetChar( int );
     double  GetFloat( int );
     double  ReadFloat( unsigned int );
-    int     GetShort( list<AbiTagRecord>::iterator );
-    int     GetLong( list<AbiTagRecord>::iterator );
-    char    GetChar( list<AbiTagRecord>::iterator );
-    double  GetFloat( list<AbiTagRecord>::iterator );
-    vector<int>&    GetShort( list<AbiTagRecord>::iterator, vector<int>& );
-    vector<int>&    GetLong( list<AbiTagRecord>::iterator, vector<int>& );
-    vector<char>&   GetChar( list<AbiTagRecord>::iterator, vector<char>& );
-    vector<double>& GetFloat( list<AbiTagRecord>::iterator, vector<double>& );
-
-    double  GetTime( list<AbiTagRecord>::iterator );
-    string& GetTime( list<AbiTagRecord>::iterator, string& );
-    string& GetDate( list<AbiTagRecord>::iterator, string& );
-    string& GetString( list<AbiTagRecord>::iterator, string& );
+    int     GetShort( vector<AbiTagRecord>::iterator );
+    int     GetLong( vector<AbiTagRecord>::iterator );
+    char    GetChar( vector<AbiTagRecord>::iterator );
+    double  GetFloat( vector<AbiTagRecord>::iterator );
+    pmr::vector<int>&   GetShort( vector<AbiTagRecord>::iterator, pmr::vector<int>& );
+    pmr::vector<int>&   GetLong( vector<AbiTagRecord>::iterator, pmr::vector<int>& );
+    vector<char>&   GetChar( vector<AbiTagRecord>::iterator, vector<char>& );
+    pmr::vector<double>&    GetFloat( vector<AbiTagRecord>::iterator, pmr::vector<double>& );
+
+    double  GetTime( vector<AbiTagRecord>::iterator );
+    string& GetTime( vector<AbiTagRecord>::iterator, string& );
+    string& GetDate( vector<AbiTagRecord>::iterator, string& );
+    string& GetString( vector<AbiTagRecord>::iterator, string& );
     string& GetString( int, int, string& );
-    list<AbiTagRecord>::iterator FindFlag( const string&, const int );
-    list<PEAKDATA>& GetPeakRecord( list<AbiTagRecord>::iterator, list<PEAKDATA>&, int );
+    bool    GetText( vector<AbiTagRecord>::iterator, string& );
+    vector<AbiTagRecord>::iterator FindFlag( const string&, const int );
+    vector<AbiTagRecord>::iterator FindFlag( const unsigned int, const int );
+    list<PEAKDATA>& GetPeakRecord( vector<AbiTagRecord>::iterator, list<PEAKDATA>&, int );
+    PEAKTABLE&      GetPeakRecord( vector<AbiTagRecord>::iterator, PEAKTABLE&, int );
 };
 
 #endif  // _ABI_FILE_H
@@ -0,0 +1,84 @@
+/*
+ * abiindex.cpp
+ *
+ * hashed index over the tag directory of an ABI tracefile
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <abiindex.h>
+
+/*
+ * index every record in the directory; the table is kept at most half full
+ * and its storage is reused when the next file is indexed
+*/
+void AbiTagIndex::Build(
+    const vector<AbiTagRecord>& _record )
+{
+    unsigned int size = 16;
+
+    while ( size < 2 * _record.size() )
+    {
+        size <<= 1;
+    }
+
+    SLOT empty = { 0, -1 };
+    vSlot.assign( size, empty );
+    pRecord = &_record; nMask = size - 1; nCount = 0;
+
+    for ( size_t i = 0; i < _record.size(); ++i )
+    {
+        unsigned long long key = GetKey( _record[ i ].GetFlagCode(), _record[ i ].GetFlagID() );
+        unsigned int slot = GetSlot( key );
+
+        while ( !( vSlot[ slot ].nIndex < 0 ) && !( vSlot[ slot ].nKey == key ) )
+        {
+            slot = ( slot + 1 ) & nMask;
+        }   // linear probing
+
+        if ( !( vSlot[ slot ].nIndex < 0 ) )
+        {
+            continue;
+        }   // duplicate entries; the first one in the directory wins
+
+        vSlot[ slot ].nKey = key;
+        vSlot[ slot ].nIndex = static_cast<int>( i );
+        ++nCount;
+    }
+}   // end of Build()
+
+void AbiTagIndex::Clear()
+{
+    vSlot.clear(); pRecord = NULL; nMask = 0; nCount = 0;
+}
+
+const vector<AbiTagRecord>& AbiTagIndex::GetRecord() const
+{
+    static const vector<AbiTagRecord> empty;
+
+    return( pRecord ? *pRecord : empty );
+}
+
+/*
+ * find the tag record with a specified flag and id
+*/
+int AbiTagIndex::FindIndex(
+    unsigned int _code, int _fid ) const
+{
+    if ( vSlot.empty() )
+    {
+        return( -1 );
+    }
+
+    unsigned long long key = GetKey( _code, _fid );
+
+    for ( unsigned int slot = GetSlot( key ); !( vSlot[ slot ].nIndex < 0 ); slot = ( slot + 1 ) & nMask )
+    {
+        if ( vSlot[ slot ].nKey == key )
+        {
+            return( vSlot[ slot ].nIndex );
+        }
+    }
+
+    return( -1 );
+}   // end of FindIndex()
@@ -0,0 +1,76 @@
+/*
+ * abiindex.h
+ *
+ * hashed index over the tag directory of an ABI tracefile
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_INDEX_H
+#define _ABI_INDEX_H
+
+// C++ header files
+#include <vector>
+
+#include <abitag.h>
+
+using namespace std;
+
+/*
+ * open addressing hash table keyed on the packed flag name and the flag id;
+ * the tag records themselves stay in the directory array, the index only
+ * holds their positions, so it must be rebuilt whenever the array changes
+*/
+class AbiTagIndex
+{
+public:
+    AbiTagIndex() : pRecord( NULL ), nMask( 0 ), nCount( 0 ) {}
+    ~AbiTagIndex() {}
+
+    void Build( const vector<AbiTagRecord>& );
+    void Clear();
+
+    // position in the directory, or -1 if there is no such tag
+    int FindIndex( unsigned int, int ) const;
+
+    const AbiTagRecord* Find( unsigned int _code, int _fid ) const
+    {
+        int i = FindIndex( _code, _fid );
+        return( ( i < 0 ) ? NULL : &( *pRecord )[ i ] );
+    }
+
+    const AbiTagRecord* Find( const string& _flag, int _fid ) const
+    {
+        return( Find( AbiFlagCode( _flag ), _fid ) );
+    }
+
+    int GetCount() const    { return( nCount ); }
+
+    // the directory the index was built on, in file order; empty if none
+    const vector<AbiTagRecord>& GetRecord() const;
+
+private:
+    struct SLOT
+    {
+        unsigned long long nKey;    // flag code (high) and flag id (low)
+        int nIndex;                 // position in the directory; -1 if empty
+    };
+
+    const vector<AbiTagRecord>* pRecord;
+    vector<SLOT>    vSlot;
+    unsigned int    nMask;      // table size minus one; size is a power of two
+    int             nCount;     // number of distinct keys
+
+    static unsigned long long GetKey( unsigned int _code, int _fid )
+    {
+        return( ( static_cast<unsigned long long>( _code ) << 0x20 ) | static_cast<unsigned int>( _fid ) );
+    }
+
+    unsigned int GetSlot( unsigned long long _key ) const
+    {
+        // fibonacci hashing; the high bits are the well mixed ones
+        return( static_cast<unsigned int>( ( _key * 0x9E3779B97F4A7C15ULL ) >> 0x20 ) & nMask );
+    }
+};
+
+#endif  // _ABI_INDEX_H
@@ -0,0 +1,119 @@
+/*
+ * abilod.cpp
+ *
+ * min/max level of detail pyramid for displaying the signals
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <algorithm>
+
+#include <abilod.h>
+
+// Query finds the buckets with shifts
+static_assert( abiLODFANOUT == 4, "the pyramid fan out must be 4" );
+
+/*
+ * the first level is made in one pass over the samples; every level above
+ * is made from the one below, which is a quarter of the size
+*/
+void AbiPyramid::Build(
+    const int* _src, size_t _count )
+{
+    nSamples = _count; nLevels = 0;
+
+    for ( size_t size = _count, step = 1; size > 1; step *= abiLODFANOUT )
+    {
+        size = ( size + abiLODFANOUT - 1 ) / abiLODFANOUT;
+
+        if ( !( static_cast<int>( vLevel.size() ) > nLevels ) )
+        {
+            vLevel.push_back( LEVEL() );
+        }
+
+        LEVEL& level = vLevel[ nLevels ];
+        level.nStep = step * abiLODFANOUT;
+        level.vMin.resize( size ); level.vMax.resize( size );
+
+        // the samples are the level below the first one, with min = max
+        size_t below = ( nLevels > 0 ) ? vLevel[ nLevels - 1 ].vMin.size() : _count;
+        const int* lo = ( nLevels > 0 ) ? vLevel[ nLevels - 1 ].vMin.data() : _src;
+        const int* hi = ( nLevels > 0 ) ? vLevel[ nLevels - 1 ].vMax.data() : _src;
+
+        for ( size_t i = 0; i < size; ++i )
+        {
+            size_t first = i * abiLODFANOUT;
+            size_t last = min( first + abiLODFANOUT, below );
+            int a = lo[ first ], b = hi[ first ];
+
+            for ( size_t k = first + 1; k < last; ++k )
+            {
+                a = min( a, lo[ k ] ); b = max( b, hi[ k ] );
+            }
+
+            level.vMin[ i ] = a; level.vMax[ i ] = b;
+        }
+
+        ++nLevels;
+    }
+}   // end of Build()
+
+/*
+ * the coarsest level whose buckets still fit in _span samples; -1 if even
+ * the first level is too coarse and the samples should be used
+*/
+int AbiPyramid::SelectLevel(
+    size_t _span ) const
+{
+    int level = -1;
+
+    while ( level + 1 < nLevels && !( vLevel[ level + 1 ].nStep > _span ) )
+    {
+        ++level;
+    }
+
+    return( level );
+}
+
+/*
+ * min/max of samples [_first, _last) in _pixels columns; the columns are
+ * made of whole buckets, so a column may reach a little past its share.
+ * returns the number of columns written, which is smaller than _pixels when
+ * there are fewer samples than pixels
+*/
+int AbiPyramid::Query(
+    const int* _src, size_t _first, size_t _last, int _pixels, int* _min, int* _max ) const
+{
+    _last = min( _last, nSamples );
+
+    if ( !( _first < _last ) || !( _pixels > 0 ) )
+    {
+        return( 0 );
+    }
+
+    size_t span = _last - _first;
+    size_t columns = min( static_cast<size_t>( _pixels ), span );
+    int level = SelectLevel( span / columns );
+    const int* lo = ( level < 0 ) ? _src : vLevel[ level ].vMin.data();
+    const int* hi = ( level < 0 ) ? _src : vLevel[ level ].vMax.data();
+    int shift = 2 * ( level + 1 );  // the steps are powers of abiLODFANOUT
+    size_t begin = _first;
+
+    for ( size_t c = 0; c < columns; ++c )
+    {
+        size_t end = _first + span * ( c + 1 ) / columns;
+        size_t first = begin >> shift, last = ( end - 1 ) >> shift;
+        int a = lo[ first ], b = hi[ first ];
+
+        begin = end;
+
+        for ( size_t k = first + 1; !( k > last ); ++k )
+        {
+            a = min( a, lo[ k ] ); b = max( b, hi[ k ] );
+        }
+
+        _min[ c ] = a; _max[ c ] = b;
+    }
+
+    return( static_cast<int>( columns ) );
+}   // end of Query()
@@ -0,0 +1,59 @@
+/*
+ * abilod.h
+ *
+ * min/max level of detail pyramid for displaying the signals
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_LOD_H
+#define _ABI_LOD_H
+
+#include <stddef.h>
+
+// C++ header files
+#include <vector>
+
+using namespace std;
+
+const int abiLODFANOUT = 4;     // buckets of a level merged into one above it
+
+/*
+ * the minimum and maximum of every abiLODFANOUT samples, of every
+ * abiLODFANOUT of those, and so on up to a single bucket. a viewer drawing
+ * any part of a signal reads the level whose buckets are just narrower than
+ * a pixel, so a redraw costs the number of pixels rather than samples. the
+ * pyramid does not keep the samples; zoomed in past the first level they
+ * are read from the signal itself
+*/
+class AbiPyramid
+{
+public:
+    AbiPyramid() : nSamples( 0 ), nLevels( 0 ) {}
+
+    void Build( const int*, size_t );
+
+    size_t GetSamples() const       { return( nSamples ); }
+    int GetLevelCount() const       { return( nLevels ); }
+    size_t GetStep( int _l ) const  { return( vLevel[ _l ].nStep ); }
+    size_t GetSize( int _l ) const  { return( vLevel[ _l ].vMin.size() ); }
+    const int* GetMin( int _l ) const   { return( vLevel[ _l ].vMin.data() ); }
+    const int* GetMax( int _l ) const   { return( vLevel[ _l ].vMax.data() ); }
+
+    int SelectLevel( size_t ) const;
+    int Query( const int*, size_t, size_t, int, int*, int* ) const;
+
+private:
+    struct LEVEL
+    {
+        size_t nStep;       // samples per bucket
+        vector<int> vMin;
+        vector<int> vMax;
+    };
+
+    vector<LEVEL>   vLevel;     // kept with their capacity between signals
+    size_t          nSamples;
+    int             nLevels;    // levels in use
+};
+
+#endif  // _ABI_LOD_H
@@ -0,0 +1,268 @@
+/*
+ * abiplate.cpp
+ *
+ * one container file for all the traces of a run folder
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cstring>
+#include <algorithm>
+
+#include <abiplate.h>
+
+static_assert( sizeof( ABIPLATEHEADER ) == 64, "plate header must be 64 bytes" );
+static_assert( sizeof( ABIPLATEENTRY ) == 256, "plate entry must be 256 bytes" );
+
+static uint64_t Align(
+    uint64_t _n )
+{
+    return( ( _n + colALIGN - 1 ) & ~static_cast<uint64_t>( colALIGN - 1 ) );
+}
+
+/*
+ * copy a name into a fixed width, zero padded field
+*/
+static void SetName(
+    char* _dst, size_t _size, const string& _src )
+{
+    memset( _dst, 0, _size );
+    memcpy( _dst, _src.data(), ( _src.length() < _size ) ? _src.length() : _size - 1 );
+}
+
+static bool WriteAt(
+    int _fd, const void* _data, size_t _size, uint64_t _offset )
+{
+    const char* p = static_cast<const char*>( _data );
+
+    while ( _size > 0 )
+    {
+        ssize_t n = pwrite( _fd, p, _size, _offset );
+
+        if ( n < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if ( n < 0 )
+        {
+            return( false );
+        }
+
+        p += n; _size -= n; _offset += n;
+    }
+
+    return( true );
+}
+
+static bool CompareEntry(
+    const ABIPLATEENTRY& _a, const ABIPLATEENTRY& _b )
+{
+    return( strncmp( _a.szName, _b.szName, sizeof( _a.szName ) ) < 0 );
+}
+
+AbiPlateWriter::~AbiPlateWriter()
+{
+    if ( !( nFile < 0 ) )
+    {
+        close( nFile ); unlink( ( szFilename + ".tmp" ).c_str() );
+    }
+}
+
+bool AbiPlateWriter::Open(
+    const string& _filename )
+{
+    lock_guard<mutex> lock( mLock );
+
+    if ( !( nFile < 0 ) )
+    {
+        return( false );
+    }
+
+    szFilename = _filename;
+    nFile = open( ( _filename + ".tmp" ).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    nEnd = sizeof( ABIPLATEHEADER );
+    vEntry.clear();
+
+    return( !( nFile < 0 ) );
+}
+
+/*
+ * the columns of one trace under its name, sample name and lane
+*/
+bool AbiPlateWriter::Add(
+    const string& _name, const string& _sample, int _lane, AbiColumnWriter& _col )
+{
+    ABIPLATEENTRY entry;
+
+    memset( &entry, 0, sizeof( entry ) );
+    SetName( entry.szName, sizeof( entry.szName ), _name );
+    SetName( entry.szSample, sizeof( entry.szSample ), _sample );
+    entry.nLane = _lane; entry.nSize = _col.GetFileSize();
+
+    {
+        lock_guard<mutex> lock( mLock );
+
+        if ( nFile < 0 )
+        {
+            return( false );
+        }
+
+        entry.nOffset = nEnd;
+        nEnd = Align( nEnd + entry.nSize );
+    }
+
+    bool ok = _col.Write( nFile, entry.nOffset );
+
+    lock_guard<mutex> lock( mLock );
+
+    if ( ok )
+    {
+        vEntry.push_back( entry );
+    }
+
+    // the space stays in the file, but nothing points at it
+    return( ok );
+}
+
+/*
+ * the table of contents, then the header that points at it
+*/
+bool AbiPlateWriter::Close()
+{
+    lock_guard<mutex> lock( mLock );
+
+    if ( nFile < 0 )
+    {
+        return( false );
+    }
+
+    ABIPLATEHEADER header;
+    uint64_t contents = Align( nEnd );
+
+    sort( vEntry.begin(), vEntry.end(), CompareEntry );
+
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.szMagic, plateMAGIC, sizeof( plateMAGIC ) );
+    header.nVersion = plateVERSION; header.nByteOrder = colBYTEORDER;
+    header.nTraces = vEntry.size(); header.nContents = contents;
+    header.nFileSize = contents + vEntry.size() * sizeof( ABIPLATEENTRY );
+
+    bool ok = WriteAt( nFile, vEntry.data(), vEntry.size() * sizeof( ABIPLATEENTRY ), contents ) &&
+        WriteAt( nFile, &header, sizeof( header ), 0 ) && !ftruncate( nFile, header.nFileSize );
+
+    string temp = szFilename + ".tmp";
+
+    ok = !close( nFile ) && ok;
+    nFile = -1;
+
+    if ( !ok || rename( temp.c_str(), szFilename.c_str() ) )
+    {
+        unlink( temp.c_str() ); return( false );
+    }
+
+    return( true );
+}   // end of Close()
+
+/*
+ * map the file and check the header, the table of contents and that every
+ * trace is in bounds; the traces themselves are checked when opened
+*/
+bool AbiPlateFile::Open(
+    const char* _filename )
+{
+    struct stat fs;
+
+    Close();
+
+    int fd = open( _filename, O_RDONLY );
+
+    if ( fd < 0 )
+    {
+        return( false );
+    }
+
+    if ( fstat( fd, &fs ) || fs.st_size < static_cast<off_t>( sizeof( ABIPLATEHEADER ) ) )
+    {
+        close( fd ); return( false );
+    }
+
+    void* p = mmap( NULL, fs.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+
+    if ( p == MAP_FAILED )
+    {
+        return( false );
+    }
+
+    szBuffer = static_cast<const unsigned char*>( p ); nSize = fs.st_size;
+    pHeader = reinterpret_cast<const ABIPLATEHEADER*>( szBuffer );
+
+    bool valid = !memcmp( pHeader->szMagic, plateMAGIC, sizeof( plateMAGIC ) ) &&
+        pHeader->nVersion == plateVERSION && pHeader->nByteOrder == colBYTEORDER &&
+        pHeader->nFileSize == nSize && !( pHeader->nContents % colALIGN ) &&
+        !( pHeader->nContents > nSize ) &&
+        !( pHeader->nTraces > ( nSize - pHeader->nContents ) / sizeof( ABIPLATEENTRY ) );
+
+    if ( valid )
+    {
+        pEntry = reinterpret_cast<const ABIPLATEENTRY*>( szBuffer + pHeader->nContents );
+
+        for ( uint32_t i = 0; valid && i < pHeader->nTraces; ++i )
+        {
+            const ABIPLATEENTRY& e = pEntry[ i ];
+            valid = !( e.nOffset % colALIGN ) && !( e.nOffset > nSize ) && !( e.nSize > nSize - e.nOffset );
+        }
+    }
+
+    if ( !valid )
+    {
+        Close();
+    }
+
+    return( valid );
+}   // end of Open()
+
+void AbiPlateFile::Close()
+{
+    if ( szBuffer )
+    {
+        munmap( const_cast<unsigned char*>( szBuffer ), nSize );
+    }
+
+    szBuffer = NULL; nSize = 0; pHeader = NULL; pEntry = NULL;
+}
+
+/*
+ * binary search of the sorted table of contents
+*/
+int AbiPlateFile::FindTrace(
+    const char* _name ) const
+{
+    ABIPLATEENTRY key;
+
+    SetName( key.szName, sizeof( key.szName ), _name );
+
+    const ABIPLATEENTRY* end = pEntry + GetTraceCount();
+    const ABIPLATEENTRY* i = lower_bound( pEntry, end, key, CompareEntry );
+
+    return( ( i == end || CompareEntry( key, *i ) ) ? -1 : static_cast<int>( i - pEntry ) );
+}
+
+bool AbiPlateFile::GetTrace(
+    int _i, AbiColumnFile& _col ) const
+{
+    if ( _i < 0 || !( _i < GetTraceCount() ) )
+    {
+        return( false );
+    }
+
+    return( _col.Open( szBuffer + pEntry[ _i ].nOffset, pEntry[ _i ].nSize ) );
+}
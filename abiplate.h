@@ -0,0 +1,118 @@
+/*
+ * abiplate.h
+ *
+ * one container file for all the traces of a run folder
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_PLATE_H
+#define _ABI_PLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C++ header files
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <abicol.h>
+
+using namespace std;
+
+/*
+ * file layout, all integers in the byte order of the machine that wrote it:
+ *
+ *  header      64 bytes, ABIPLATEHEADER
+ *  traces      one columnar image per trace (see abicol.h), each on a 64
+ *              byte boundary, in the order they were converted
+ *  contents    one ABIPLATEENTRY per trace, sorted by name
+ *
+ * a trace is read by finding its entry and handing its part of the file to
+ * AbiColumnFile, so none of the other traces is touched
+*/
+const char plateMAGIC[ 8 ] = { 'A', 'B', 'I', 'P', 'L', 'A', 'T', 'E' };
+const uint32_t plateVERSION = 1;
+
+struct ABIPLATEHEADER
+{
+    char        szMagic[ 8 ];   // "ABIPLATE"
+    uint32_t    nVersion;
+    uint32_t    nByteOrder;     // colBYTEORDER as written
+    uint32_t    nTraces;        // entries in the table of contents
+    uint32_t    nReserved;
+    uint64_t    nContents;      // offset of the table of contents
+    uint64_t    nFileSize;
+    char        szPadding[ 24 ];
+};
+
+struct ABIPLATEENTRY
+{
+    char        szName[ 160 ];  // file name of the trace, without the folder
+    char        szSample[ 64 ]; // SpNm
+    int32_t     nLane;          // LANE; -1 if the trace has none
+    uint32_t    nReserved;
+    uint64_t    nOffset;        // columnar image, from the start of the file
+    uint64_t    nSize;
+    char        szPadding[ 8 ];
+};
+
+/*
+ * traces are added from any number of threads: space is reserved under the
+ * lock and the images are written outside it. the file is built under a
+ * temporary name and renamed once the table of contents is written
+*/
+class AbiPlateWriter
+{
+public:
+    AbiPlateWriter() : nFile( -1 ), nEnd( 0 ) {}
+    ~AbiPlateWriter();
+
+    bool Open( const string& );
+    bool Add( const string&, const string&, int, AbiColumnWriter& );
+    bool Close();       // false if anything failed to write
+
+    size_t GetTraceCount() const    { return( vEntry.size() ); }
+
+private:
+    string                  szFilename;
+    int                     nFile;
+    uint64_t                nEnd;       // where the next trace goes
+    vector<ABIPLATEENTRY>   vEntry;
+    mutex                   mLock;
+
+    AbiPlateWriter( const AbiPlateWriter& );
+    AbiPlateWriter& operator=( const AbiPlateWriter& );
+};
+
+/*
+ * maps a container read-only and opens its traces in place
+*/
+class AbiPlateFile
+{
+public:
+    AbiPlateFile() : szBuffer( NULL ), nSize( 0 ), pHeader( NULL ), pEntry( NULL ) {}
+    ~AbiPlateFile()     { Close(); }
+
+    bool Open( const char* );
+    void Close();
+
+    int GetTraceCount() const   { return( pHeader ? static_cast<int>( pHeader->nTraces ) : 0 ); }
+    const ABIPLATEENTRY& GetEntry( int _i ) const   { return( pEntry[ _i ] ); }
+    int FindTrace( const char* ) const;     // -1 if there is none
+
+    // the columns of one trace; valid while this file is open
+    bool GetTrace( int, AbiColumnFile& ) const;
+
+private:
+    const unsigned char*    szBuffer;
+    size_t                  nSize;
+    const ABIPLATEHEADER*   pHeader;
+    const ABIPLATEENTRY*    pEntry;
+
+    AbiPlateFile( const AbiPlateFile& );
+    AbiPlateFile& operator=( const AbiPlateFile& );
+};
+
+#endif  // _ABI_PLATE_H
@@ -0,0 +1,164 @@
+/*
+ * abipool.cpp
+ *
+ * work stealing thread pool for batch processing of tracefiles
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <abipool.h>
+
+// index of the pool worker running on this thread; -1 elsewhere
+static thread_local int nWorkerID = -1;
+static thread_local const AbiWorkPool* pWorkerPool = NULL;
+
+AbiWorkPool::AbiWorkPool(
+    int _size ) :
+    nQueued( 0 ), nPending( 0 ), nNext( 0 ), bStop( false )
+{
+    _size = ( _size > 0 ) ? _size : 1;
+
+    for ( int i = 0; i < _size; ++i )
+    {
+        vQueue.push_back( new QUEUE );
+    }
+
+    for ( int i = 0; i < _size; ++i )
+    {
+        vWorker.push_back( thread( &AbiWorkPool::Run, this, i ) );
+    }
+}
+
+AbiWorkPool::~AbiWorkPool()
+{
+    Wait();
+
+    {
+        lock_guard<mutex> lock( mIdle ); bStop = true;
+    }
+
+    cvWork.notify_all();
+
+    for ( size_t i = 0; i < vWorker.size(); ++i )
+    {
+        vWorker[ i ].join();
+    }
+
+    for ( size_t i = 0; i < vQueue.size(); ++i )
+    {
+        delete vQueue[ i ];
+    }
+}
+
+/*
+ * number of workers to use when the caller does not say
+*/
+int AbiWorkPool::GetDefaultSize()
+{
+    int size = static_cast<int>( thread::hardware_concurrency() );
+
+    return( ( size > 0 ) ? size : 1 );
+}
+
+/*
+ * queue a task; a worker submitting more work keeps it on its own deque
+*/
+void AbiWorkPool::Submit(
+    const TASK& _task )
+{
+    int id = ( pWorkerPool == this ) ? nWorkerID : static_cast<int>( nNext++ % vQueue.size() );
+
+    ++nPending;
+
+    {
+        lock_guard<mutex> lock( vQueue[ id ]->mLock );
+        vQueue[ id ]->dqTask.push_back( _task );
+    }
+
+    {
+        // taking the lock orders the count with a worker about to sleep
+        lock_guard<mutex> lock( mIdle ); ++nQueued;
+    }
+
+    cvWork.notify_one();
+}
+
+void AbiWorkPool::Wait()
+{
+    unique_lock<mutex> lock( mIdle );
+
+    while ( nPending > 0 )
+    {
+        cvDone.wait( lock );
+    }
+}
+
+/*
+ * take from the front of our own deque, otherwise steal from the back of
+ * the others, starting with our neighbour
+*/
+bool AbiWorkPool::Take(
+    int _id, TASK& _task )
+{
+    int size = static_cast<int>( vQueue.size() );
+
+    for ( int i = 0; i < size; ++i )
+    {
+        QUEUE* q = vQueue[ ( _id + i ) % size ];
+        lock_guard<mutex> lock( q->mLock );
+
+        if ( q->dqTask.empty() )
+        {
+            continue;
+        }
+
+        if ( i == 0 )
+        {
+            _task = q->dqTask.front(); q->dqTask.pop_front();
+        }
+        else
+        {
+            _task = q->dqTask.back(); q->dqTask.pop_back();
+        }
+
+        --nQueued; return( true );
+    }
+
+    return( false );
+}   // end of Take()
+
+void AbiWorkPool::Run(
+    int _id )
+{
+    TASK task;
+
+    nWorkerID = _id; pWorkerPool = this;
+
+    for ( ;; )
+    {
+        if ( !Take( _id, task ) )
+        {
+            unique_lock<mutex> lock( mIdle );
+
+            while ( !bStop && !( nQueued > 0 ) )
+            {
+                cvWork.wait( lock );
+            }
+
+            if ( bStop && !( nQueued > 0 ) )
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        task( _id ); task = TASK();
+
+        if ( --nPending == 0 )
+        {
+            lock_guard<mutex> lock( mIdle );
+            cvDone.notify_all();
+        }
+    }
+}   // end of Run()
@@ -0,0 +1,68 @@
+/*
+ * abipool.h
+ *
+ * work stealing thread pool for batch processing of tracefiles
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_POOL_H
+#define _ABI_POOL_H
+
+// C++ header files
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+/*
+ * every worker has its own deque: it takes work from the front of its own,
+ * so tasks a worker queues run in the order they were queued, and steals
+ * from the back of the others once it runs dry. tasks are given the index
+ * of the worker running them so callers can keep per-worker state
+*/
+class AbiWorkPool
+{
+public:
+    typedef function<void( int )> TASK;
+
+    explicit AbiWorkPool( int );
+    ~AbiWorkPool();
+
+    void Submit( const TASK& );
+    void Wait();        // block until every submitted task has finished
+    int GetSize() const { return( static_cast<int>( vWorker.size() ) ); }
+
+    static int GetDefaultSize();
+
+private:
+    struct QUEUE
+    {
+        mutex       mLock;
+        deque<TASK> dqTask;
+    };
+
+    vector<QUEUE*>  vQueue;
+    vector<thread>  vWorker;
+
+    mutex               mIdle;
+    condition_variable  cvWork;     // signalled when a task is queued
+    condition_variable  cvDone;     // signalled when the pool drains
+    atomic<long>        nQueued;    // tasks waiting in the deques
+    atomic<long>        nPending;   // tasks submitted but not finished
+    atomic<unsigned>    nNext;      // round robin for outside submissions
+    bool                bStop;
+
+    AbiWorkPool( const AbiWorkPool& );
+    AbiWorkPool& operator=( const AbiWorkPool& );
+
+    void Run( int );
+    bool Take( int, TASK& );
+};
+
+#endif  // _ABI_POOL_H
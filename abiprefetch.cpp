@@ -0,0 +1,430 @@
+/*
+ * abiprefetch.cpp
+ *
+ * asynchronous reads of the tracefiles ahead of the workers
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <cstring>
+#include <algorithm>
+
+#include <abiprefetch.h>
+
+AbiPrefetcher::AbiPrefetcher(
+    int _window, const READY& _ready, bool _async ) :
+    fnReady( _ready ), nWindow( ( _window > 0 ) ? _window : 1 ),
+    nSlot( nWindow ), bFinish( false ),
+    nRing( -1 ), pRingSQ( NULL ), pRingCQ( NULL ), nRingSQ( 0 ), nRingCQ( 0 ),
+    pRingSQE( NULL ), nRingSQE( 0 ), nQueued( 0 )
+{
+    if ( _async && SetupRing( nWindow ) )
+    {
+        vFlight.resize( nWindow );
+
+        for ( int i = 0; i < nWindow; ++i )
+        {
+            vFree.push_back( i );
+        }
+
+        vReader.push_back( thread( &AbiPrefetcher::RunRing, this ) );
+        return;
+    }
+
+    for ( int i = 0; i < nWindow; ++i )
+    {
+        vReader.push_back( thread( &AbiPrefetcher::RunReader, this ) );
+    }
+}
+
+AbiPrefetcher::~AbiPrefetcher()
+{
+    Finish(); CloseRing();
+}
+
+/*
+ * map the submission and completion rings of a new io_uring instance; fails
+ * on kernels without io_uring or where it has been turned off
+*/
+bool AbiPrefetcher::SetupRing(
+    unsigned _entries )
+{
+    io_uring_params p;
+    memset( &p, 0, sizeof( p ) );
+
+    nRing = static_cast<int>( syscall( __NR_io_uring_setup, _entries, &p ) );
+
+    if ( nRing < 0 )
+    {
+        nRing = -1; return( false );
+    }
+
+    nRingSQ = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+    nRingCQ = p.cq_off.cqes + p.cq_entries * sizeof( io_uring_cqe );
+    nRingSQE = p.sq_entries * sizeof( io_uring_sqe );
+
+    // newer kernels share one mapping between both rings
+    if ( p.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        nRingSQ = nRingCQ = max( nRingSQ, nRingCQ );
+    }
+
+    void* sq = mmap( NULL, nRingSQ, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, nRing, IORING_OFF_SQ_RING );
+    pRingSQ = ( sq == MAP_FAILED ) ? NULL : sq;
+
+    if ( p.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        pRingCQ = pRingSQ;
+    }
+    else
+    {
+        void* cq = mmap( NULL, nRingCQ, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, nRing, IORING_OFF_CQ_RING );
+        pRingCQ = ( cq == MAP_FAILED ) ? NULL : cq;
+    }
+
+    void* sqe = mmap( NULL, nRingSQE, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, nRing, IORING_OFF_SQES );
+    pRingSQE = ( sqe == MAP_FAILED ) ? NULL : sqe;
+
+    if ( !pRingSQ || !pRingCQ || !pRingSQE )
+    {
+        CloseRing(); return( false );
+    }
+
+    char* s = static_cast<char*>( pRingSQ );
+    char* c = static_cast<char*>( pRingCQ );
+
+    pSQHead = reinterpret_cast<unsigned*>( s + p.sq_off.head );
+    pSQTail = reinterpret_cast<unsigned*>( s + p.sq_off.tail );
+    pSQMask = reinterpret_cast<unsigned*>( s + p.sq_off.ring_mask );
+    pSQArray = reinterpret_cast<unsigned*>( s + p.sq_off.array );
+    pCQHead = reinterpret_cast<unsigned*>( c + p.cq_off.head );
+    pCQTail = reinterpret_cast<unsigned*>( c + p.cq_off.tail );
+    pCQMask = reinterpret_cast<unsigned*>( c + p.cq_off.ring_mask );
+    pCQE = c + p.cq_off.cqes;
+
+    return( true );
+}   // end of SetupRing()
+
+void AbiPrefetcher::CloseRing()
+{
+    if ( pRingSQE )
+    {
+        munmap( pRingSQE, nRingSQE );
+    }
+
+    if ( pRingCQ && !( pRingCQ == pRingSQ ) )
+    {
+        munmap( pRingCQ, nRingCQ );
+    }
+
+    if ( pRingSQ )
+    {
+        munmap( pRingSQ, nRingSQ );
+    }
+
+    if ( !( nRing < 0 ) )
+    {
+        close( nRing );
+    }
+
+    pRingSQ = pRingCQ = pRingSQE = NULL; nRing = -1;
+}
+
+/*
+ * queue a file to be read; files are read in the order they are added. the
+ * number is handed back with the file, so the caller can number the files
+ * it does not prefetch from the same count
+*/
+void AbiPrefetcher::Add(
+    const string& _file, size_t _seq )
+{
+    ABIPREFETCH file = { _file, NULL, 0, _seq, abiERROR_NONE, 0 };
+
+    {
+        lock_guard<mutex> lock( mLock );
+        dqFile.push_back( file );
+    }
+
+    cvWork.notify_one();
+}
+
+/*
+ * give back the slot of a delivered file so the next one can be read
+*/
+void AbiPrefetcher::Release()
+{
+    {
+        lock_guard<mutex> lock( mLock ); ++nSlot;
+    }
+
+    cvWork.notify_one();
+}
+
+/*
+ * no more files will be added; returns once every file has been delivered.
+ * the files must be released elsewhere, or this waits for a free slot forever
+*/
+void AbiPrefetcher::Finish()
+{
+    {
+        lock_guard<mutex> lock( mLock ); bFinish = true;
+    }
+
+    cvWork.notify_all();
+
+    for ( size_t i = 0; i < vReader.size(); ++i )
+    {
+        vReader[ i ].join();
+    }
+
+    vReader.clear();
+}
+
+/*
+ * take the next file once a slot is free; without waiting, only if one can
+ * be had right away. false if there is nothing to take
+*/
+bool AbiPrefetcher::TakeFile(
+    ABIPREFETCH& _file, bool _wait )
+{
+    unique_lock<mutex> lock( mLock );
+
+    while ( _wait && !( nSlot > 0 && !dqFile.empty() ) && !( bFinish && dqFile.empty() ) )
+    {
+        cvWork.wait( lock );
+    }
+
+    if ( !( nSlot > 0 ) || dqFile.empty() )
+    {
+        return( false );
+    }
+
+    _file = dqFile.front(); dqFile.pop_front(); --nSlot;
+
+    return( true );
+}
+
+/*
+ * the file could not be read; nothing is delivered with it but the reason
+*/
+static void FailFile(
+    ABIPREFETCH& _file, AbiError _error, int _errno )
+{
+    delete [] _file.szBuffer; _file.szBuffer = NULL;
+    _file.nError = _error; _file.nErrno = _errno;
+}
+
+/*
+ * open the file and allocate its buffer; false if there is nothing to read,
+ * because it cannot be opened or is too short to be a tracefile
+*/
+bool AbiPrefetcher::OpenFile(
+    ABIPREFETCH& _file, int& _fd )
+{
+    struct stat fs;
+
+    _fd = open( _file.szFilename.c_str(), O_RDONLY );
+
+    if ( _fd < 0 )
+    {
+        FailFile( _file, abiERROR_OPEN, errno ); return( false );
+    }
+
+    if ( fstat( _fd, &fs ) )
+    {
+        int error = errno;
+
+        close( _fd ); FailFile( _file, abiERROR_OPEN, error ); return( false );
+    }
+
+    _file.nSize = fs.st_size;
+
+    if ( _file.nSize < static_cast<size_t>( abifHEADERSIZE ) )
+    {
+        close( _fd ); FailFile( _file, abiERROR_SIZE, 0 ); return( false );
+    }
+
+    _file.szBuffer = new unsigned char [ _file.nSize ];
+
+    return( true );
+}
+
+void AbiPrefetcher::Deliver(
+    ABIPREFETCH& _file )
+{
+    fnReady( _file );
+    _file.szBuffer = NULL;
+}
+
+/*
+ * put a read of the rest of a file into the submission ring; the ring has
+ * an entry for every slot, so it never fills up
+*/
+void AbiPrefetcher::QueueRead(
+    int _i )
+{
+    FLIGHT& f = vFlight[ _i ];
+    unsigned tail = *pSQTail;
+    unsigned index = tail & *pSQMask;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>( pRingSQE ) + index;
+
+    f.ioVector.iov_base = f.file.szBuffer + f.nDone;
+    f.ioVector.iov_len = f.file.nSize - f.nDone;
+
+    memset( sqe, 0, sizeof( *sqe ) );
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = f.fd;
+    sqe->addr = reinterpret_cast<uintptr_t>( &f.ioVector );
+    sqe->len = 1;
+    sqe->off = f.nDone;
+    sqe->user_data = _i;
+
+    pSQArray[ index ] = index;
+    __atomic_store_n( pSQTail, tail + 1, __ATOMIC_RELEASE );
+    ++nQueued;
+}
+
+/*
+ * a single thread opens the files and keeps the reads of the whole window
+ * in the ring, submitting and reaping them with one system call per round
+*/
+void AbiPrefetcher::RunRing()
+{
+    ABIPREFETCH file;
+    int flight = 0;     // files in the ring
+    int fd;
+
+    for ( ;; )
+    {
+        // only wait for more files when there is nothing in the ring
+        while ( TakeFile( file, flight == 0 ) )
+        {
+            if ( !OpenFile( file, fd ) )
+            {
+                Deliver( file ); continue;
+            }
+
+            int i = vFree.back(); vFree.pop_back();
+            vFlight[ i ].file = file; vFlight[ i ].fd = fd; vFlight[ i ].nDone = 0;
+            QueueRead( i ); ++flight;
+        }
+
+        if ( flight == 0 )
+        {
+            break;
+        }
+
+        int n = static_cast<int>( syscall( __NR_io_uring_enter, nRing, nQueued, 1,
+            IORING_ENTER_GETEVENTS, NULL, 0 ) );
+
+        if ( n < 0 && !( errno == EINTR || errno == EAGAIN || errno == EBUSY ) )
+        {
+            break;
+        }
+
+        nQueued -= ( n > 0 ) ? n : 0;
+
+        unsigned head = *pCQHead;
+        unsigned tail = __atomic_load_n( pCQTail, __ATOMIC_ACQUIRE );
+
+        for ( ; !( head == tail ); ++head )
+        {
+            io_uring_cqe* cqe = static_cast<io_uring_cqe*>( pCQE ) + ( head & *pCQMask );
+            int i = static_cast<int>( cqe->user_data );
+            FLIGHT& f = vFlight[ i ];
+
+            if ( cqe->res == -EINTR || cqe->res == -EAGAIN )
+            {
+                QueueRead( i ); continue;
+            }
+
+            if ( cqe->res > 0 )
+            {
+                f.nDone += cqe->res;
+
+                if ( f.nDone < f.file.nSize )
+                {
+                    QueueRead( i ); continue;
+                }
+            }
+            else
+            {
+                FailFile( f.file, abiERROR_READ, -cqe->res );
+            }
+
+            close( f.fd ); Deliver( f.file );
+            vFree.push_back( i ); --flight;
+        }
+
+        __atomic_store_n( pCQHead, head, __ATOMIC_RELEASE );
+    }
+
+    if ( flight == 0 )
+    {
+        return;
+    }
+
+    // the ring is broken; the kernel may still write into the buffers of the
+    // files in it, so those are given up on and the rest is read in here
+    for ( size_t i = 0; i < vFlight.size(); ++i )
+    {
+        if ( find( vFree.begin(), vFree.end(), static_cast<int>( i ) ) == vFree.end() )
+        {
+            close( vFlight[ i ].fd );
+            vFlight[ i ].file.szBuffer = NULL; vFlight[ i ].file.nError = abiERROR_READ;
+            Deliver( vFlight[ i ].file );
+        }
+    }
+
+    RunReader();
+}   // end of RunRing()
+
+/*
+ * one blocking reader per slot when io_uring is not available
+*/
+void AbiPrefetcher::RunReader()
+{
+    ABIPREFETCH file;
+    int fd;
+
+    while ( TakeFile( file, true ) )
+    {
+        if ( OpenFile( file, fd ) )
+        {
+            size_t done = 0;
+
+            while ( done < file.nSize )
+            {
+                ssize_t n = pread( fd, file.szBuffer + done, file.nSize - done, done );
+
+                if ( n < 0 && errno == EINTR )
+                {
+                    continue;
+                }
+
+                if ( !( n > 0 ) )
+                {
+                    FailFile( file, abiERROR_READ, ( n < 0 ) ? errno : 0 ); break;
+                }
+
+                done += n;
+            }
+
+            close( fd );
+        }
+
+        Deliver( file );
+    }
+}   // end of RunReader()
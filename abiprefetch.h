@@ -0,0 +1,118 @@
+/*
+ * abiprefetch.h
+ *
+ * asynchronous reads of the tracefiles ahead of the workers
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_PREFETCH_H
+#define _ABI_PREFETCH_H
+
+#include <sys/uio.h>
+
+// C++ header files
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <abifile.h>
+
+using namespace std;
+
+/*
+ * a tracefile read into memory. the buffer comes from new[] and belongs to
+ * whoever is handed the file, normally AbiFile::LoadBuffer; it is NULL if
+ * the file could not be read, and nError says why
+*/
+struct ABIPREFETCH
+{
+    string          szFilename;
+    unsigned char*  szBuffer;
+    size_t          nSize;      // size of the file (bytes)
+    size_t          nSeq;       // number the caller gave the file
+    AbiError        nError;     // why there is no buffer
+    int             nErrno;     // errno of the failed call; 0 if none
+};
+
+/*
+ * keeps a window of upcoming files being read while the earlier ones are
+ * decoded and written. the reads go through io_uring when the kernel allows
+ * it, otherwise through one reader thread per window slot. a file keeps its
+ * slot from the moment it is opened until Release is called for it, so at
+ * most a window of files is held in memory. the ready function is called
+ * from the reading threads
+*/
+class AbiPrefetcher
+{
+public:
+    typedef function<void( ABIPREFETCH& )> READY;
+
+    AbiPrefetcher( int, const READY&, bool = true );
+    ~AbiPrefetcher();
+
+    void Add( const string&, size_t );  // queue a file and its number; safe from any thread
+    void Release();             // a delivered file is done with
+    void Finish();              // no more files; wait until all are delivered
+
+    bool IsAsync() const    { return( nRing >= 0 ); }
+    int GetWindow() const   { return( nWindow ); }
+
+private:
+    // a file being read by the ring
+    struct FLIGHT
+    {
+        ABIPREFETCH file;
+        int         fd;
+        size_t      nDone;      // bytes read so far
+        iovec       ioVector;
+    };
+
+    READY           fnReady;
+    int             nWindow;
+    vector<thread>  vReader;
+
+    mutex               mLock;
+    condition_variable  cvWork;     // signalled on a new file or a free slot
+    deque<ABIPREFETCH>  dqFile;     // added, not opened yet
+    int                 nSlot;      // free slots in the window
+    bool                bFinish;
+
+    // io_uring; set up by SetupRing, nRing is -1 without it
+    int             nRing;
+    void*           pRingSQ;
+    void*           pRingCQ;
+    size_t          nRingSQ;
+    size_t          nRingCQ;
+    void*           pRingSQE;
+    size_t          nRingSQE;
+    unsigned*       pSQHead;
+    unsigned*       pSQTail;
+    unsigned*       pSQMask;
+    unsigned*       pSQArray;
+    unsigned*       pCQHead;
+    unsigned*       pCQTail;
+    unsigned*       pCQMask;
+    void*           pCQE;
+    vector<FLIGHT>  vFlight;        // indexed by the user data of a request
+    vector<int>     vFree;          // unused entries of vFlight
+    unsigned        nQueued;        // requests in the ring, not submitted yet
+
+    AbiPrefetcher( const AbiPrefetcher& );
+    AbiPrefetcher& operator=( const AbiPrefetcher& );
+
+    bool SetupRing( unsigned );
+    void CloseRing();
+    void RunRing();
+    void RunReader();
+    bool OpenFile( ABIPREFETCH&, int& );
+    void QueueRead( int );
+    void Deliver( ABIPREFETCH& );
+    bool TakeFile( ABIPREFETCH&, bool );
+};
+
+#endif  // _ABI_PREFETCH_H
@@ -0,0 +1,317 @@
+/*
+ * abiseparate.cpp
+ *
+ * multicomponent separation of the raw channels with the MTRX matrix
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <math.h>
+#include <limits.h>
+
+// C++ header files
+#include <algorithm>
+
+#include <abidecode.h>
+#include <abiseparate.h>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+    #define ABI_SEPARATE_X86
+    #include <immintrin.h>
+#endif
+
+typedef void ( *SEPARATOR )( const float*, int, const int* const*, int* const*, size_t, size_t );
+
+/*
+ * samples _first to _count; also used for the tail of the vectorized loops.
+ * the sums are rounded to the nearest integer, as cvtps_epi32 does
+*/
+static void SeparateScalar(
+    const float* _m, int _n, const int* const* _src, int* const* _dst, size_t _first, size_t _count )
+{
+    float x[ abiSEPARATEMAX ];
+
+    for ( size_t i = _first; i < _count; ++i )
+    {
+        for ( int f = 0; f < _n; ++f )
+        {
+            x[ f ] = static_cast<float>( _src[ f ][ i ] );
+        }
+
+        for ( int d = 0; d < _n; ++d )
+        {
+            const float* row = _m + d * _n;
+            float y = row[ 0 ] * x[ 0 ];
+
+            for ( int f = 1; f < _n; ++f )
+            {
+                y = y + row[ f ] * x[ f ];
+            }
+
+            _dst[ d ][ i ] = static_cast<int>( lrintf( y ) );
+        }
+    }
+}
+
+#ifdef ABI_SEPARATE_X86
+/*
+ * SSE2: four samples of every filter, each dye a sum of broadcast
+ * coefficients times the filters
+*/
+static void SeparateSSE2(
+    const float* _m, int _n, const int* const* _src, int* const* _dst, size_t _first, size_t _count )
+{
+    size_t i = _first;
+
+    for ( ; i + 4 <= _count; i += 4 )
+    {
+        __m128 x[ abiSEPARATEMAX ];
+
+        for ( int f = 0; f < _n; ++f )
+        {
+            x[ f ] = _mm_cvtepi32_ps( _mm_loadu_si128( reinterpret_cast<const __m128i*>( _src[ f ] + i ) ) );
+        }
+
+        for ( int d = 0; d < _n; ++d )
+        {
+            const float* row = _m + d * _n;
+            __m128 y = _mm_mul_ps( _mm_set1_ps( row[ 0 ] ), x[ 0 ] );
+
+            for ( int f = 1; f < _n; ++f )
+            {
+                y = _mm_add_ps( y, _mm_mul_ps( _mm_set1_ps( row[ f ] ), x[ f ] ) );
+            }
+
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( _dst[ d ] + i ), _mm_cvtps_epi32( y ) );
+        }
+    }
+
+    SeparateScalar( _m, _n, _src, _dst, i, _count );
+}
+
+/*
+ * AVX2: the same eight samples at a time, with the multiplies and adds kept
+ * apart as in SSE2, so both give the same numbers
+*/
+__attribute__(( target( "avx2" ) ))
+static void SeparateAVX2(
+    const float* _m, int _n, const int* const* _src, int* const* _dst, size_t _first, size_t _count )
+{
+    size_t i = _first;
+
+    for ( ; i + 8 <= _count; i += 8 )
+    {
+        __m256 x[ abiSEPARATEMAX ];
+
+        for ( int f = 0; f < _n; ++f )
+        {
+            x[ f ] = _mm256_cvtepi32_ps( _mm256_loadu_si256( reinterpret_cast<const __m256i*>( _src[ f ] + i ) ) );
+        }
+
+        for ( int d = 0; d < _n; ++d )
+        {
+            const float* row = _m + d * _n;
+            __m256 y = _mm256_mul_ps( _mm256_set1_ps( row[ 0 ] ), x[ 0 ] );
+
+            for ( int f = 1; f < _n; ++f )
+            {
+                y = _mm256_add_ps( y, _mm256_mul_ps( _mm256_set1_ps( row[ f ] ), x[ f ] ) );
+            }
+
+            _mm256_storeu_si256( reinterpret_cast<__m256i*>( _dst[ d ] + i ), _mm256_cvtps_epi32( y ) );
+        }
+    }
+
+    SeparateSSE2( _m, _n, _src, _dst, i, _count );
+}
+#endif  // ABI_SEPARATE_X86
+
+/*
+ * the instruction set of the array decoders, so AbiSetDecodeTarget forces
+ * this one as well
+*/
+static SEPARATOR GetSeparator()
+{
+#ifdef ABI_SEPARATE_X86
+    switch ( AbiGetDecodeTarget() )
+    {
+    case abiDECODE_SSE2:
+    case abiDECODE_SSSE3:   return( SeparateSSE2 );
+    case abiDECODE_AVX2:    return( SeparateAVX2 );
+    default:                break;
+    }
+#endif
+
+    return( SeparateScalar );
+}
+
+/*
+ * minimum (erosion) or maximum (dilation) over the window of 2 _half + 1
+ * samples centred on each sample, van Herk and Gil-Werman: the channel is
+ * padded at both ends with _none, which neither can pick, and cut into
+ * blocks of the window width that are run forward and backward, so any
+ * window is the backward run at its first sample joined with the forward run
+ * at its last. three passes whatever the width, without a branch on the data
+*/
+template<class PICK> static void Filter(
+    const int* _src, int* _dst, size_t _count, size_t _half, int _none, vector<int>& _pad,
+    vector<int>& _ahead, vector<int>& _behind, PICK _pick )
+{
+    size_t width = 2 * _half + 1, size = _count + 2 * _half;
+
+    _pad.assign( size, _none ); _ahead.resize( size ); _behind.resize( size );
+    copy( _src, _src + _count, _pad.begin() + _half );
+
+    for ( size_t begin = 0; begin < size; begin += width )
+    {
+        size_t end = ( begin + width < size ) ? begin + width : size;
+
+        _ahead[ begin ] = _pad[ begin ]; _behind[ end - 1 ] = _pad[ end - 1 ];
+
+        for ( size_t i = begin + 1; i < end; ++i )
+        {
+            _ahead[ i ] = _pick( _ahead[ i - 1 ], _pad[ i ] );
+        }
+
+        for ( size_t i = end - 1; i > begin; --i )
+        {
+            _behind[ i - 1 ] = _pick( _behind[ i ], _pad[ i - 1 ] );
+        }
+    }
+
+    for ( size_t i = 0; i < _count; ++i )
+    {
+        _dst[ i ] = _pick( _behind[ i ], _ahead[ i + 2 * _half ] );
+    }
+}   // end of Filter()
+
+/*
+ * scale the columns, then invert by Gauss-Jordan elimination with partial
+ * pivoting in double; a pivot that is tiny next to the largest element
+ * means the dyes cannot be told apart
+*/
+bool AbiSeparator::SetMatrix(
+    const int* _matrix, size_t _size )
+{
+    int n = static_cast<int>( sqrt( static_cast<double>( _size ) ) + 0.5 );
+    double a[ abiSEPARATEMAX ][ 2 * abiSEPARATEMAX ];
+    double largest = 0.0;
+
+    nChannels = 0; vInverse.clear();
+
+    if ( !( n > 0 ) || n > abiSEPARATEMAX || !( static_cast<size_t>( n * n ) == _size ) )
+    {
+        return( false );
+    }
+
+    for ( int d = 0; d < n; ++d )
+    {
+        double peak = 0.0;
+
+        for ( int f = 0; f < n; ++f )
+        {
+            peak = ( fabs( _matrix[ f * n + d ] ) > fabs( peak ) ) ? _matrix[ f * n + d ] : peak;
+        }
+
+        if ( peak == 0.0 )
+        {
+            return( false );
+        }
+
+        for ( int f = 0; f < n; ++f )
+        {
+            a[ f ][ d ] = _matrix[ f * n + d ] / peak;
+            a[ f ][ n + d ] = ( f == d ) ? 1.0 : 0.0;
+            largest = ( fabs( a[ f ][ d ] ) > largest ) ? fabs( a[ f ][ d ] ) : largest;
+        }
+    }
+
+    for ( int c = 0; c < n; ++c )
+    {
+        int pivot = c;
+
+        for ( int r = c + 1; r < n; ++r )
+        {
+            pivot = ( fabs( a[ r ][ c ] ) > fabs( a[ pivot ][ c ] ) ) ? r : pivot;
+        }
+
+        if ( fabs( a[ pivot ][ c ] ) < largest * 1e-9 )
+        {
+            return( false );
+        }
+
+        for ( int k = 0; k < 2 * n; ++k )
+        {
+            double t = a[ c ][ k ]; a[ c ][ k ] = a[ pivot ][ k ]; a[ pivot ][ k ] = t;
+        }
+
+        double scale = a[ c ][ c ];
+
+        for ( int k = 0; k < 2 * n; ++k )
+        {
+            a[ c ][ k ] /= scale;
+        }
+
+        for ( int r = 0; r < n; ++r )
+        {
+            double factor = a[ r ][ c ];
+
+            for ( int k = 0; !( r == c ) && k < 2 * n; ++k )
+            {
+                a[ r ][ k ] -= factor * a[ c ][ k ];
+            }
+        }
+    }
+
+    nChannels = n; vInverse.resize( n * n );
+
+    for ( int d = 0; d < n; ++d )
+    {
+        for ( int f = 0; f < n; ++f )
+        {
+            vInverse[ d * n + f ] = static_cast<float>( a[ d ][ n + f ] );
+        }
+    }
+
+    return( true );
+}   // end of SetMatrix()
+
+void AbiSeparator::Separate(
+    const int* const* _src, int* const* _dst, size_t _count )
+{
+    AbiTimer timer( pStats, abiSTAGE_SEPARATE );
+    const int* src[ abiSEPARATEMAX ];
+
+    for ( int f = 0; f < nChannels; ++f )
+    {
+        src[ f ] = _src[ f ];
+    }
+
+    if ( nBaseline > 1 && _count > 0 )
+    {
+        size_t half = static_cast<size_t>( nBaseline / 2 );
+
+        vCorrected.resize( nChannels * _count ); vWork.resize( _count );
+
+        // the baseline is built where the corrected channel goes, then taken from the raw one
+        for ( int f = 0; f < nChannels; ++f )
+        {
+            int* corrected = vCorrected.data() + f * _count;
+
+            Filter( _src[ f ], vWork.data(), _count, half, INT_MAX, vPad, vAhead, vBehind,
+                []( int a, int b ) { return( ( b < a ) ? b : a ); } );
+            Filter( vWork.data(), corrected, _count, half, INT_MIN, vPad, vAhead, vBehind,
+                []( int a, int b ) { return( ( a < b ) ? b : a ); } );
+
+            for ( size_t i = 0; i < _count; ++i )
+            {
+                corrected[ i ] = _src[ f ][ i ] - corrected[ i ];
+            }
+
+            src[ f ] = corrected;
+        }
+    }
+
+    GetSeparator()( vInverse.data(), nChannels, src, _dst, 0, _count );
+    timer.Set( static_cast<uint64_t>( nChannels ) * _count * sizeof( int ), nChannels * _count );
+}   // end of Separate()
@@ -0,0 +1,64 @@
+/*
+ * abiseparate.h
+ *
+ * multicomponent separation of the raw channels with the MTRX matrix
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_SEPARATE_H
+#define _ABI_SEPARATE_H
+
+#include <stddef.h>
+
+// C++ header files
+#include <vector>
+
+#include <abistats.h>
+
+using namespace std;
+
+const int abiSEPARATEMAX = 8;   // most filters and dyes a matrix may have
+
+/*
+ * the filters of the CCD see every dye through the spectra of the others,
+ * raw = M x dye, with one row of M per filter and one column per dye. MTRX
+ * holds M row by row as fixed point numbers; each column is scaled so the
+ * dye peaks at 1, which keeps the dyes in the units of the raw channels
+ * whatever scale the instrument used. the dyes are the raw channels times
+ * the inverse of M, taken four or eight samples at a time with SSE2 or AVX2,
+ * whichever the array decoders use. if a baseline window is set, the
+ * baseline of each raw channel is removed first: the opening of the channel
+ * by a flat window, which follows it everywhere but the peaks narrower than
+ * the window
+*/
+class AbiSeparator
+{
+public:
+    AbiSeparator() : nChannels( 0 ), nBaseline( 0 ), pStats( NULL ) {}
+
+    // MTRX as decoded, n x n; false if it is not square or is singular
+    bool SetMatrix( const int*, size_t );
+    void SetBaseline( int _w )      { nBaseline = ( _w > 0 ) ? _w : 0; }    // samples; 0 for none
+    void SetStats( AbiStats* _s )   { pStats = _s; }
+
+    int GetChannelCount() const     { return( nChannels ); }
+    int GetBaseline() const         { return( nBaseline ); }
+    float GetCoefficient( int _d, int _f ) const    { return( vInverse[ _d * nChannels + _f ] ); }
+
+    // GetChannelCount raw channels of _count samples into as many dyes
+    void Separate( const int* const*, int* const*, size_t );
+
+private:
+    int             nChannels;
+    int             nBaseline;  // width of the window
+    vector<float>   vInverse;   // dye by filter
+    vector<int>     vCorrected; // the raw channels less their baseline
+    vector<int>     vWork;      // erosion of the channel being corrected
+    vector<int>     vPad;       // the channel being filtered, padded
+    vector<int>     vAhead;     // running extremes from the start of each block
+    vector<int>     vBehind;    // and from its end
+    AbiStats*       pStats;     // NULL if not measured
+};
+
+#endif  // _ABI_SEPARATE_H
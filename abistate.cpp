@@ -0,0 +1,237 @@
+/*
+ * abistate.cpp
+ *
+ * record of the tracefiles converted so far, for incremental conversion
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <cstring>
+#include <fstream>
+
+#include <abistate.h>
+
+static const char* stateHEADER = "abi2csv state 1";
+
+/*
+ * a 64-bit hash of the contents, eight bytes at a time; 0 if the file cannot
+ * be read. not meant to resist tampering, only to notice changed contents
+*/
+uint64_t AbiHashFile(
+    const string& _file )
+{
+    struct stat fs;
+    int fd = open( _file.c_str(), O_RDONLY );
+
+    if ( fd < 0 )
+    {
+        return( 0 );
+    }
+
+    if ( fstat( fd, &fs ) )
+    {
+        close( fd ); return( 0 );
+    }
+
+    size_t size = fs.st_size;
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ size, word;
+    void* p = ( size > 0 ) ? mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 ) : NULL;
+
+    close( fd );
+
+    if ( p == MAP_FAILED )
+    {
+        return( 0 );
+    }
+
+    const unsigned char* data = static_cast<const unsigned char*>( p );
+    size_t i = 0;
+
+    madvise( p, size, MADV_SEQUENTIAL );
+
+    for ( ; !( i + sizeof( word ) > size ); i += sizeof( word ) )
+    {
+        memcpy( &word, data + i, sizeof( word ) );
+        hash = ( hash ^ word ) * 0xFF51AFD7ED558CCDULL; hash ^= hash >> 0x20;
+    }
+
+    if ( i < size )
+    {
+        word = 0; memcpy( &word, data + i, size - i );
+        hash = ( hash ^ word ) * 0xFF51AFD7ED558CCDULL; hash ^= hash >> 0x20;
+    }
+
+    if ( p )
+    {
+        munmap( p, size );
+    }
+
+    hash ^= hash >> 0x21; hash *= 0xC4CEB9FE1A85EC53ULL; hash ^= hash >> 0x21;
+
+    return( ( hash == 0 ) ? 1 : hash );
+}   // end of AbiHashFile()
+
+/*
+ * read the record; a missing file is an empty record. false if the file is
+ * not a record, which is then ignored, so everything is converted again
+*/
+bool AbiState::Load(
+    const string& _file )
+{
+    ifstream in( _file.c_str() );
+    string line;
+    lock_guard<mutex> lock( mLock );
+
+    mpState.clear(); mpPending.clear(); bChanged = false;
+
+    if ( !in )
+    {
+        return( true );
+    }
+
+    if ( !getline( in, line ) || !( line == stateHEADER ) )
+    {
+        return( false );
+    }
+
+    // size, modification time, hash and the path, which may hold spaces
+    while ( getline( in, line ) )
+    {
+        ABISTATE state;
+        unsigned long long size, hash;
+        long long modified;
+        int length = 0;
+
+        if ( !( sscanf( line.c_str(), "%llu %lld %llx %n", &size, &modified, &hash, &length ) == 3 ) ||
+            !( static_cast<size_t>( length ) < line.length() ) )
+        {
+            mpState.clear(); return( false );
+        }
+
+        state.nSize = size; state.nModified = modified; state.nHash = hash;
+        mpState[ line.substr( length ) ] = state;
+    }
+
+    return( true );
+}   // end of Load()
+
+/*
+ * write the record if anything was recorded, to a temporary file renamed
+ * over the old one
+*/
+bool AbiState::Save(
+    const string& _file )
+{
+    lock_guard<mutex> lock( mLock );
+
+    if ( !bChanged )
+    {
+        return( true );
+    }
+
+    string temp = _file + ".tmp";
+    FILE* file = fopen( temp.c_str(), "w" );
+
+    if ( !file )
+    {
+        return( false );
+    }
+
+    fprintf( file, "%s\n", stateHEADER );
+
+    for ( STATEMAP::const_iterator i = mpState.begin(); !( i == mpState.end() ); ++i )
+    {
+        // a path with a line break can't be kept; the file is converted every time
+        if ( ( *i ).first.find( '\n' ) == string::npos )
+        {
+            fprintf( file, "%llu %lld %llx %s\n", static_cast<unsigned long long>( ( *i ).second.nSize ),
+                static_cast<long long>( ( *i ).second.nModified ),
+                static_cast<unsigned long long>( ( *i ).second.nHash ), ( *i ).first.c_str() );
+        }
+    }
+
+    bool ok = !ferror( file ) && !fflush( file ) && !fsync( fileno( file ) );
+    ok = !fclose( file ) && ok;
+
+    if ( !ok || rename( temp.c_str(), _file.c_str() ) )
+    {
+        unlink( temp.c_str() ); return( false );
+    }
+
+    bChanged = false;
+
+    return( true );
+}   // end of Save()
+
+/*
+ * true if the file is unchanged since it was last converted; the hash is
+ * only taken when the size matches but the modification time does not, or
+ * for a file that is going to be converted
+*/
+bool AbiState::Check(
+    const string& _file )
+{
+    struct stat fs;
+    ABISTATE now;
+
+    if ( stat( _file.c_str(), &fs ) )
+    {
+        return( false );
+    }
+
+    now.nSize = fs.st_size; now.nHash = 0;
+    now.nModified = static_cast<int64_t>( fs.st_mtim.tv_sec ) * 1000000000 + fs.st_mtim.tv_nsec;
+
+    ABISTATE old = { 0, 0, 0 };
+    bool found;
+
+    {
+        lock_guard<mutex> lock( mLock );
+        STATEMAP::const_iterator i = mpState.find( _file );
+
+        found = !( i == mpState.end() );
+        old = found ? ( *i ).second : old;
+    }
+
+    if ( found && old.nSize == now.nSize && old.nModified == now.nModified )
+    {
+        return( true );
+    }
+
+    now.nHash = bHash ? AbiHashFile( _file ) : 0;
+
+    lock_guard<mutex> lock( mLock );
+
+    // the same contents with a new time; remember the time and skip the file
+    if ( found && old.nSize == now.nSize && !( now.nHash == 0 ) && old.nHash == now.nHash )
+    {
+        mpState[ _file ] = now; bChanged = true;
+        return( true );
+    }
+
+    mpPending[ _file ] = now;
+
+    return( false );
+}   // end of Check()
+
+/*
+ * the file has been converted; record the state Check found it in
+*/
+void AbiState::Commit(
+    const string& _file )
+{
+    lock_guard<mutex> lock( mLock );
+    STATEMAP::iterator i = mpPending.find( _file );
+
+    if ( !( i == mpPending.end() ) )
+    {
+        mpState[ _file ] = ( *i ).second; bChanged = true;
+        mpPending.erase( i );
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * abistate.h
+ *
+ * record of the tracefiles converted so far, for incremental conversion
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_STATE_H
+#define _ABI_STATE_H
+
+#include <stdint.h>
+
+// C++ header files
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+/*
+ * a tracefile as it was when it was converted
+*/
+struct ABISTATE
+{
+    uint64_t nSize;         // bytes
+    int64_t nModified;      // modification time (ns since the epoch)
+    uint64_t nHash;         // AbiHashFile of the contents; 0 if not taken
+};
+
+uint64_t AbiHashFile( const string& );
+
+/*
+ * a file is up to date if its size and modification time are the ones it
+ * had when it was last converted; with hashing, a file that was only touched
+ * or copied over with the same contents is up to date as well. Check keeps
+ * the state a changed file is found in, and Commit records that state once
+ * the file is converted, so a file changed while it is being converted is
+ * converted again next time. Check and Commit may be called by several
+ * workers; the record is kept in a text file, one file per line
+*/
+class AbiState
+{
+public:
+    explicit AbiState( bool _hash = false ) : bHash( _hash ), bChanged( false ) {}
+
+    bool Load( const string& );
+    bool Save( const string& );
+
+    bool Check( const string& );
+    void Commit( const string& );
+
+    size_t GetCount() const     { return( mpState.size() ); }
+
+private:
+    typedef unordered_map<string, ABISTATE> STATEMAP;
+
+    mutex       mLock;
+    STATEMAP    mpState;        // files as they were converted
+    STATEMAP    mpPending;      // files found changed, as they were found
+    bool        bHash;          // compare the contents too
+    bool        bChanged;       // anything recorded since Load
+};
+
+#endif  // _ABI_STATE_H
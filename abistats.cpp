@@ -0,0 +1,184 @@
+/*
+ * abistats.cpp
+ *
+ * per-stage timing and counters of the tracefile conversion
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <stdio.h>
+
+#include <cstring>
+
+#include <abistats.h>
+
+static const char* statsNAME[ abiSTAGE_COUNT ] =
+{
+    "load", "parse", "decode", "separate", "csv", "column", "file"
+};
+
+const char* AbiStats::GetStageName(
+    AbiStage _s )
+{
+    return( statsNAME[ _s ] );
+}
+
+void AbiStats::Clear()
+{
+    memset( vStage, 0, sizeof( vStage ) );
+    memset( vLatency, 0, sizeof( vLatency ) );
+    nMaxLatency = 0;
+}
+
+void AbiStats::Add(
+    AbiStage _s, uint64_t _time, uint64_t _bytes, uint64_t _items )
+{
+    ABISTAGE& stage = vStage[ _s ];
+
+    ++stage.nCalls; stage.nTime += _time;
+    stage.nBytes += _bytes; stage.nItems += _items;
+
+    if ( _s == abiSTAGE_FILE )
+    {
+        int b = 0;
+
+        for ( uint64_t us = _time / 1000; us > 0 && b < abiLATENCYBUCKETS - 1; us >>= 1 )
+        {
+            ++b;
+        }
+
+        ++vLatency[ b ];
+        nMaxLatency = ( _time > nMaxLatency ) ? _time : nMaxLatency;
+    }
+}
+
+void AbiStats::Merge(
+    const AbiStats& _s )
+{
+    for ( int i = 0; i < abiSTAGE_COUNT; ++i )
+    {
+        vStage[ i ].nCalls += _s.vStage[ i ].nCalls; vStage[ i ].nTime += _s.vStage[ i ].nTime;
+        vStage[ i ].nBytes += _s.vStage[ i ].nBytes; vStage[ i ].nItems += _s.vStage[ i ].nItems;
+    }
+
+    for ( int b = 0; b < abiLATENCYBUCKETS; ++b )
+    {
+        vLatency[ b ] += _s.vLatency[ b ];
+    }
+
+    nMaxLatency = ( _s.nMaxLatency > nMaxLatency ) ? _s.nMaxLatency : nMaxLatency;
+}
+
+/*
+ * the time per file below which the given fraction of the files took; only
+ * as fine as the buckets
+*/
+uint64_t AbiStats::GetPercentile(
+    double _p ) const
+{
+    uint64_t total = vStage[ abiSTAGE_FILE ].nCalls, seen = 0;
+
+    for ( int b = 0; b < abiLATENCYBUCKETS; ++b )
+    {
+        seen += vLatency[ b ];
+
+        if ( total > 0 && !( seen < _p * total ) )
+        {
+            return( 1ULL << b );
+        }
+    }
+
+    return( 0 );
+}
+
+/*
+ * a table of the stages and the histogram of the time per file; the stage
+ * times are summed over the workers, so the shares are of the summed time
+*/
+void AbiStats::Print(
+    ostream& _out, double _wall ) const
+{
+    char line[ 160 ];
+    uint64_t busy = 0;
+
+    for ( int i = 0; i < abiSTAGE_FILE; ++i )
+    {
+        busy += vStage[ i ].nTime;
+    }
+
+    snprintf( line, sizeof( line ), "%-8s %10s %12s %7s %12s %14s", "stage", "calls", "time (s)", "share",
+        "MB", "items" );
+    _out << line << endl;
+
+    for ( int i = 0; i < abiSTAGE_COUNT; ++i )
+    {
+        const ABISTAGE& s = vStage[ i ];
+
+        snprintf( line, sizeof( line ), "%-8s %10llu %12.3f %6.1f%% %12.2f %14llu", statsNAME[ i ],
+            static_cast<unsigned long long>( s.nCalls ), s.nTime / 1e9,
+            ( i == abiSTAGE_FILE || busy == 0 ) ? 100.0 : 100.0 * s.nTime / busy,
+            s.nBytes / 1e6, static_cast<unsigned long long>( s.nItems ) );
+        _out << line << endl;
+    }
+
+    const ABISTAGE& file = vStage[ abiSTAGE_FILE ];
+
+    snprintf( line, sizeof( line ), "%llu file(s) in %.3f s, %.1f files/s; per file p50 < %llu us, "
+        "p90 < %llu us, p99 < %llu us, max %llu us", static_cast<unsigned long long>( file.nCalls ), _wall,
+        ( _wall > 0 ) ? file.nCalls / _wall : 0.0, static_cast<unsigned long long>( GetPercentile( 0.5 ) ),
+        static_cast<unsigned long long>( GetPercentile( 0.9 ) ),
+        static_cast<unsigned long long>( GetPercentile( 0.99 ) ),
+        static_cast<unsigned long long>( GetMaxLatency() ) );
+    _out << line << endl;
+
+    for ( int b = 0; b < abiLATENCYBUCKETS; ++b )
+    {
+        if ( vLatency[ b ] > 0 )
+        {
+            snprintf( line, sizeof( line ), "  < %10llu us %10llu", 1ULL << b,
+                static_cast<unsigned long long>( vLatency[ b ] ) );
+            _out << line << endl;
+        }
+    }
+}   // end of Print()
+
+/*
+ * the same as one JSON object
+*/
+bool AbiStats::WriteJSON(
+    const string& _filename, double _wall ) const
+{
+    FILE* file = fopen( _filename.c_str(), "w" );
+
+    if ( !file )
+    {
+        return( false );
+    }
+
+    fprintf( file, "{\n  \"wall_seconds\": %.6f,\n  \"stages\": {\n", _wall );
+
+    for ( int i = 0; i < abiSTAGE_COUNT; ++i )
+    {
+        fprintf( file, "    \"%s\": {\"calls\": %llu, \"seconds\": %.6f, \"bytes\": %llu, \"items\": %llu}%s\n",
+            statsNAME[ i ], static_cast<unsigned long long>( vStage[ i ].nCalls ), vStage[ i ].nTime / 1e9,
+            static_cast<unsigned long long>( vStage[ i ].nBytes ),
+            static_cast<unsigned long long>( vStage[ i ].nItems ), ( i + 1 < abiSTAGE_COUNT ) ? "," : "" );
+    }
+
+    fprintf( file, "  },\n  \"latency_us\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu, \"histogram\": [",
+        static_cast<unsigned long long>( GetPercentile( 0.5 ) ), static_cast<unsigned long long>( GetPercentile( 0.9 ) ),
+        static_cast<unsigned long long>( GetPercentile( 0.99 ) ), static_cast<unsigned long long>( GetMaxLatency() ) );
+
+    for ( int b = 0, n = 0; b < abiLATENCYBUCKETS; ++b )
+    {
+        if ( vLatency[ b ] > 0 )
+        {
+            fprintf( file, "%s{\"below\": %llu, \"files\": %llu}", ( n++ > 0 ) ? ", " : "",
+                1ULL << b, static_cast<unsigned long long>( vLatency[ b ] ) );
+        }
+    }
+
+    fprintf( file, "]}\n}\n" );
+
+    return( fclose( file ) == 0 );
+}   // end of WriteJSON()
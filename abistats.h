@@ -0,0 +1,118 @@
+/*
+ * abistats.h
+ *
+ * per-stage timing and counters of the tracefile conversion
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_STATS_H
+#define _ABI_STATS_H
+
+#include <time.h>
+#include <stdint.h>
+
+// C++ header files
+#include <string>
+#include <ostream>
+
+using namespace std;
+
+/*
+ * where the time goes; the load stage includes the reads of the lazy mode
+ * made while extracting, the file stage is the whole of each file
+*/
+enum AbiStage
+{
+    abiSTAGE_LOAD,      // open, map or read the tracefile
+    abiSTAGE_PARSE,     // check the header and read the tag directory
+    abiSTAGE_DECODE,    // Extract and the Get*Data calls
+    abiSTAGE_SEPARATE,  // separate the dyes with the MTRX matrix
+    abiSTAGE_CSV,       // format and write the CSV files
+    abiSTAGE_COLUMN,    // write the columnar files
+    abiSTAGE_FILE,      // one tracefile from start to finish
+    abiSTAGE_COUNT
+};
+
+const int abiLATENCYBUCKETS = 32;   // powers of two of microseconds
+
+inline uint64_t AbiGetClock()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return( static_cast<uint64_t>( ts.tv_sec ) * 1000000000 + ts.tv_nsec );
+}
+
+struct ABISTAGE
+{
+    uint64_t nCalls;
+    uint64_t nTime;     // ns, summed over the threads
+    uint64_t nBytes;    // read, decoded or written
+    uint64_t nItems;    // tags, elements, values or columns
+};
+
+/*
+ * plain counters with no locking; keep one per thread and merge them at the
+ * end. the file stage also keeps a histogram of the time per file, bucket b
+ * holding the files that took less than 2^b microseconds
+*/
+class AbiStats
+{
+public:
+    AbiStats()  { Clear(); }
+
+    void Clear();
+    void Add( AbiStage, uint64_t, uint64_t, uint64_t );
+    void Merge( const AbiStats& );
+
+    const ABISTAGE& GetStage( AbiStage _s ) const   { return( vStage[ _s ] ); }
+    uint64_t GetLatency( int _b ) const     { return( vLatency[ _b ] ); }
+    uint64_t GetPercentile( double ) const;     // us; upper end of the bucket
+    uint64_t GetMaxLatency() const  { return( nMaxLatency / 1000 ); }
+
+    static const char* GetStageName( AbiStage );
+
+    void Print( ostream&, double ) const;
+    bool WriteJSON( const string&, double ) const;
+
+private:
+    ABISTAGE    vStage[ abiSTAGE_COUNT ];
+    uint64_t    vLatency[ abiLATENCYBUCKETS ];
+    uint64_t    nMaxLatency;    // ns
+};
+
+/*
+ * times a stage from construction to Stop or destruction; does nothing
+ * without a stats object, so the library costs one branch when not measured
+*/
+class AbiTimer
+{
+public:
+    AbiTimer( AbiStats* _s, AbiStage _stage ) :
+        pStats( _s ), nStage( _stage ), nStart( _s ? AbiGetClock() : 0 ), nBytes( 0 ), nItems( 0 ) {}
+    ~AbiTimer()     { Stop(); }
+
+    void Set( uint64_t _bytes, uint64_t _items )    { nBytes = _bytes; nItems = _items; }
+    void Add( uint64_t _bytes, uint64_t _items )    { nBytes += _bytes; nItems += _items; }
+
+    void Stop()
+    {
+        if ( pStats )
+        {
+            pStats->Add( nStage, AbiGetClock() - nStart, nBytes, nItems ); pStats = NULL;
+        }
+    }
+
+private:
+    AbiStats*   pStats;
+    AbiStage    nStage;
+    uint64_t    nStart;
+    uint64_t    nBytes;
+    uint64_t    nItems;
+
+    AbiTimer( const AbiTimer& );
+    AbiTimer& operator=( const AbiTimer& );
+};
+
+#endif  // _ABI_STATS_H
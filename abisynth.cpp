@@ -0,0 +1,212 @@
+/*
+ * abisynth.cpp
+ *
+ * synthetic ABI tracefiles for testing and benchmarks
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <stdio.h>
+#include <string.h>
+
+// C++ header files
+#include <fstream>
+
+#include <abisynth.h>
+
+const int synthTAGSIZE = 28;
+const int synthHEADERSIZE = 128;
+
+/*
+ * small deterministic generator so the files do not depend on the C library
+*/
+static unsigned int NextRandom(
+    unsigned int& _state )
+{
+    _state = _state * 1103515245u + 12345u;
+    return( ( _state >> 0x10 ) & 0x7FFF );
+}
+
+static void PutShort(
+    vector<unsigned char>& _b, unsigned int _v )
+{
+    _b.push_back( ( _v >> 0x8 ) & 0xFF ); _b.push_back( _v & 0xFF );
+}
+
+static void PutLong(
+    vector<unsigned char>& _b, unsigned int _v )
+{
+    _b.push_back( ( _v >> 0x18 ) & 0xFF ); _b.push_back( ( _v >> 0x10 ) & 0xFF );
+    _b.push_back( ( _v >> 0x8 ) & 0xFF ); _b.push_back( _v & 0xFF );
+}
+
+/*
+ * directory entries are collected first and appended after the data, the
+ * way the instruments lay the files out
+*/
+class TagWriter
+{
+public:
+    TagWriter( vector<unsigned char>& _data ) : vData( _data ), nCount( 0 ) {}
+
+    // data of four bytes or less is stored in the data value field itself
+    void Add( const char* _flag, int _fid, int _type, int _size, int _count,
+        const vector<unsigned char>& _payload )
+    {
+        vTag.insert( vTag.end(), _flag, _flag + 4 );
+        PutLong( vTag, _fid ); PutShort( vTag, _type ); PutShort( vTag, _size );
+        PutLong( vTag, _count ); PutLong( vTag, _payload.size() );
+
+        if ( _payload.size() > 4 )
+        {
+            PutLong( vTag, vData.size() );
+            vData.insert( vData.end(), _payload.begin(), _payload.end() );
+        }
+        else
+        {
+            for ( size_t i = 0; i < 4; ++i )
+            {
+                vTag.push_back( ( i < _payload.size() ) ? _payload[ i ] : 0 );
+            }
+        }
+
+        PutLong( vTag, 0 ); ++nCount;
+    }
+
+    void AddString( const char* _flag, const string& _s )
+    {
+        vector<unsigned char> payload( 1, static_cast<unsigned char>( _s.length() ) );
+        payload.insert( payload.end(), _s.begin(), _s.end() );
+        Add( _flag, 1, 18, 1, payload.size(), payload );
+    }
+
+    void AddShort( const char* _flag, int _fid, int _value )
+    {
+        vector<unsigned char> payload; PutShort( payload, _value );
+        Add( _flag, _fid, 4, 2, 1, payload );
+    }
+
+    // append the directory and point the main tag at offset 6 to it
+    void Finish()
+    {
+        unsigned int entry = vData.size();
+        vData.insert( vData.end(), vTag.begin(), vTag.end() );
+
+        vector<unsigned char> main;
+        main.insert( main.end(), "tdir", "tdir" + 4 );
+        PutLong( main, 1 ); PutShort( main, 1023 ); PutShort( main, synthTAGSIZE );
+        PutLong( main, nCount ); PutLong( main, nCount * synthTAGSIZE );
+        PutLong( main, entry ); PutLong( main, 0 );
+        memcpy( &vData[ 6 ], &main[ 0 ], main.size() );
+    }
+
+    int GetCount() const    { return( nCount ); }
+
+private:
+    vector<unsigned char>&  vData;
+    vector<unsigned char>   vTag;
+    int                     nCount;
+};
+
+/*
+ * build a complete tracefile in memory
+*/
+vector<unsigned char>& AbiMakeTrace(
+    vector<unsigned char>& _b, const ABISYNTH& _s )
+{
+    unsigned int state = _s.nSeed;
+    vector<unsigned char> payload;
+    TagWriter tag( _b );
+    char flag[ 8 ];
+
+    // signature, version and the space for the main tag; FF padded to 128
+    _b.assign( synthHEADERSIZE, 0xFF );
+    memcpy( &_b[ 0 ], "ABIF", 4 ); _b[ 4 ] = 0x00; _b[ 5 ] = 0x65;
+
+    for ( int i = 1; i < 13; ++i )
+    {
+        payload.clear();
+
+        for ( int k = 0; k < _s.nSamples; ++k )
+        {
+            // a noisy baseline with a peak every hundred samples
+            int value = 200 + NextRandom( state ) % 64 + ( ( k % 100 < 8 ) ? 4000 * ( k % 100 ) : 0 );
+            PutShort( payload, value );
+        }
+
+        tag.Add( "DATA", i, 4, 2, _s.nSamples, payload );
+    }
+
+    for ( int i = 1; i < 5; ++i )
+    {
+        tag.AddShort( "PK_#", i, _s.nPeaks );
+        payload.clear();
+
+        for ( int k = 0; k < _s.nPeaks; ++k )
+        {
+            unsigned int position = k * 100 + 7;
+            float size = 20.0f + k * 5.25f + NextRandom( state ) % 100 / 100.0f;
+            unsigned int bits;
+            memcpy( &bits, &size, sizeof( bits ) );
+
+            PutLong( payload, position ); PutShort( payload, 28000 + NextRandom( state ) % 1000 );
+            PutLong( payload, position - 6 ); PutLong( payload, position + 6 );
+            PutShort( payload, 210 ); PutShort( payload, 205 );
+            PutLong( payload, 90000 + NextRandom( state ) ); PutLong( payload, 120000 + NextRandom( state ) );
+            PutLong( payload, bits ); PutShort( payload, 0 );
+
+            char label[ 64 ] = { 0 };
+            snprintf( label, sizeof( label ), "peak %d", k + 1 );
+            payload.insert( payload.end(), label, label + sizeof( label ) );
+        }   // 96 bytes per peak
+
+        tag.Add( "PEAK", i, 1024, 96, _s.nPeaks, payload );
+    }
+
+    tag.AddString( "SpNm", "synthetic sample" );
+    tag.AddString( "User", "abisynth" );
+    tag.AddString( "DySN", "G5" );
+    tag.AddString( "StdF", "GS500LIZ.szs" );
+    tag.AddShort( "LANE", 1, 1 + _s.nSeed % 96 );
+    tag.AddShort( "Dye#", 1, 4 );
+
+    payload.clear(); PutShort( payload, 2004 ); payload.push_back( 7 ); payload.push_back( 30 );
+    tag.Add( "RUND", 1, 10, 4, 1, payload );
+    payload.clear(); payload.push_back( 9 ); payload.push_back( 41 ); payload.push_back( 5 ); payload.push_back( 0 );
+    tag.Add( "RUNT", 1, 11, 4, 1, payload );
+
+    // 4 x 4 filter matrix, close to the identity
+    payload.clear();
+
+    for ( int i = 0; i < 16; ++i )
+    {
+        PutLong( payload, ( i % 5 ) ? NextRandom( state ) % 500 : 10000 );
+    }
+
+    tag.Add( "MTRX", 1, 5, 4, 16, payload );
+
+    // instrument metadata the export does not use
+    for ( int i = 0; tag.GetCount() < _s.nTags; ++i )
+    {
+        snprintf( flag, sizeof( flag ), "X%03d", i % 1000 );
+        payload.clear(); PutLong( payload, i );
+        tag.Add( flag, i / 1000 + 1, 5, 4, 1, payload );
+    }
+
+    tag.Finish();
+
+    return( _b );
+}   // end of AbiMakeTrace()
+
+bool AbiWriteTrace(
+    const string& _filename, const ABISYNTH& _s )
+{
+    vector<unsigned char> buffer;
+    ofstream file( _filename.c_str(), ios::out | ios::binary | ios::trunc );
+
+    AbiMakeTrace( buffer, _s );
+    file.write( reinterpret_cast<const char*>( &buffer[ 0 ] ), buffer.size() );
+    file.close();
+
+    return( !file.fail() );
+}
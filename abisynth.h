@@ -0,0 +1,36 @@
+/*
+ * abisynth.h
+ *
+ * synthetic ABI tracefiles for testing and benchmarks
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_SYNTH_H
+#define _ABI_SYNTH_H
+
+// C++ header files
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * shape of the generated file; the directory always holds DATA 1-12,
+ * PK_# and PEAK 1-4 and the string and scalar tags, and is padded with
+ * filler tags up to nTags entries
+*/
+struct ABISYNTH
+{
+    int nSamples;       // samples per DATA channel
+    int nPeaks;         // peaks per filter (PK_# and PEAK)
+    int nTags;          // entries in the tag directory
+    unsigned int nSeed; // seed for the sample and peak values
+};
+
+const ABISYNTH abiSYNTHDEFAULT = { 10000, 50, 256, 1 };
+
+vector<unsigned char>& AbiMakeTrace( vector<unsigned char>&, const ABISYNTH& );
+bool AbiWriteTrace( const string&, const ABISYNTH& );
+
+#endif  // _ABI_SYNTH_H
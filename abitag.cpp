@@ -9,8 +9,10 @@
 */
 #include <abitag.h>
 
+static_assert( sizeof( AbiTagRecord ) == 28, "tag records must match the 28 byte file layout" );
+
 // ABI designated data type
-string abiTYPENAME[ 26 ] =
+static const string abiTYPENAME[ 26 ] =
 {
     "IllegalType", "Byte", "Char", "Word", "Short", "Long", "Rational", "Float", "Double", "BCD",
     "Date", "Time", "Thumb", "Boolean", "Point", "Rect", "VPoint", "VRect", "PString", "CString",
@@ -40,103 +42,93 @@ string abiTYPENAME[ 26 ] =
  * bytes.
 */
 AbiTagRecord::AbiTagRecord(
-    unsigned char* _s, const unsigned int _i ) :
-    szBuffer( _s ), nEntry( _i )
+    const unsigned char* _s, const unsigned int _i )
 {
-    // tag record can't start from 0
-    if ( !( nEntry > 0 ) )
+    unsigned int entry = _i;
+
+    // tag record can't start from 0; that is the signature, so leave an empty record
+    if ( !( entry > 0 ) )
     {
-        exit( 1 );
+        nFlagCode = 0; nFlagID = 0; nDataType = 0; nRecordSize = 0;
+        nRecordCount = 0; nRecordLength = 0; nDataValue = 0; nDataPadding = 0;
+
+        return;
     }
 
     // parse the record; note: the order is very important!
-    GetFlag( szFlagName );      // ascii flag name; 4 bytes
-    nFlagID = GetLong();        // id of the flag; 4 bytes
-    nDataType = GetDataType( GetShort() );  // ABI designated data type; 2 bytes
-    nRecordSize = GetShort();   // size of referenced record (bytes); 2 bytes
-    nRecordCount = GetLong();   // number of referenced data records; 4 bytes
-    nRecordLength = GetLong();  // length of referenced data array (bytes); 4 bytes
-    nDataValue = GetLong();     // either the data itself or a pointer; 4 bytes
-    nDataPadding = GetLong();   // purpose is unknown; 4 bytes
+    nFlagCode = GetLong( _s, entry );           // ascii flag name; 4 bytes
+    nFlagID = GetLong( _s, entry );             // id of the flag; 4 bytes
+    nDataType = GetDataType( GetShort( _s, entry ) );   // ABI designated data type; 2 bytes
+    nRecordSize = GetShort( _s, entry );        // size of referenced record (bytes); 2 bytes
+    nRecordCount = GetLong( _s, entry );        // number of referenced data records; 4 bytes
+    nRecordLength = GetLong( _s, entry );       // length of referenced data array (bytes); 4 bytes
+    nDataValue = GetLong( _s, entry );          // either the data itself or a pointer; 4 bytes
+    nDataPadding = GetLong( _s, entry );        // purpose is unknown; 4 bytes
 }
 
 /*
- * get a string from the binary tracefile
+ * the flag name as a string
 */
-string& AbiTagRecord::GetFlag(
-    string& _s )
+string AbiTagRecord::GetFlagName() const
 {
-    _s.resize( 4 );
+    char name[ 4 ] =
+    {
+        static_cast<char>( ( nFlagCode >> 0x18 ) & 0xFF ), static_cast<char>( ( nFlagCode >> 0x10 ) & 0xFF ),
+        static_cast<char>( ( nFlagCode >> 0x8 ) & 0xFF ), static_cast<char>( nFlagCode & 0xFF )
+    };
 
-    _s[ 0 ] = szBuffer[ nEntry++ ];
-    _s[ 1 ] = szBuffer[ nEntry++ ];
-    _s[ 2 ] = szBuffer[ nEntry++ ];
-    _s[ 3 ] = szBuffer[ nEntry++ ];
+    return( string( name, 4 ) );
+}
 
-    return( _s );
+const string& AbiTagRecord::GetTypeName() const
+{
+    return( abiTYPENAME[ nDataType ] );
 }
 
 /*
  * get an integer from the binary tracefile
 */
-int AbiTagRecord::GetLong()
+int AbiTagRecord::GetLong(
+    const unsigned char* _s, unsigned int& _i )
 {
     int value;
 
-    value  = szBuffer[ nEntry++ ] << 0x18;
-    value += szBuffer[ nEntry++ ] << 0x10;
-    value += szBuffer[ nEntry++ ] << 0x8;
-    value += szBuffer[ nEntry++ ];
+    value  = _s[ _i++ ] << 0x18;
+    value += _s[ _i++ ] << 0x10;
+    value += _s[ _i++ ] << 0x8;
+    value += _s[ _i++ ];
 
     return( value );
 }
 
-int AbiTagRecord::GetShort()
+int AbiTagRecord::GetShort(
+    const unsigned char* _s, unsigned int& _i )
 {
     int value;
 
-   value  = szBuffer[ nEntry++ ] << 0x8;
-    value += szBuffer[ nEntry++ ];
+    value  = _s[ _i++ ] << 0x8;
+    value += _s[ _i++ ];
 
     return( value );
 }
 
 /*
- * translate the ABI designated data type
+ * translate the ABI designated data type; 0-20 map onto themselves
 */
-int AbiTagRecord::GetDataType(
+AbiDataType AbiTagRecord::GetDataType(
     int _type )
 {
-    switch ( _type )
+    if ( !( _type < 0 ) && !( _type > abiTYPE_TAG ) )
     {
-    case 0:     _type = 0; break;   // illegal type
-    case 1:     _type = 1; break;   // byte
-    case 2:     _type = 2; break;   // char
-    case 3:     _type = 3; break;   // word
-    case 4:     _type = 4; break;   // short
-    case 5:     _type = 5; break;   // long
-    case 6:     _type = 6; break;   // rational
-    case 7:     _type = 7; break;   // float
-    case 8:     _type = 8; break;   // double
-    case 9:     _type = 9; break;   // BCD
-    case 10:    _type = 10; break;  // date
-    case 11:    _type = 11; break;  // time
-    case 12:    _type = 12; break;  // thumb
-    case 13:    _type = 13; break;  // boolean
-    case 14:    _type = 14; break;  // point
-    case 15:    _type = 15; break;  // rect
-    case 16:    _type = 16; break;  // vpoint
-    case 17:    _type = 17; break;  // vrect
-    case 18:    _type = 18; break;  // pstring
-    case 19:    _type = 19; break;  // cstring
-    case 20:    _type = 20; break;  // tag
-    case 128:   _type = 21; break;  // delta lzw compression
-    case 256:   _type = 22; break;  // lzw compression
-    case 1023:  _type = 23; break;  // directory
-    case 1024:  _type = 24; break;  // user type
-    default:    _type = 25;         // custom user type
+        return( static_cast<AbiDataType>( _type ) );
     }
 
-    szTypeName = abiTYPENAME[ _type ];
-    return( _type );
+    switch ( _type )
+    {
+    case 128:   return( abiTYPE_DELTALZW );     // delta lzw compression
+    case 256:   return( abiTYPE_LZW );          // lzw compression
+    case 1023:  return( abiTYPE_DIRECTORY );    // directory
+    case 1024:  return( abiTYPE_USERTYPE );     // user type
+    default:    return( abiTYPE_CUSTOM );       // custom user type
+    }
 }
@@ -17,22 +17,55 @@
 #include <vector>
 #include <string>
 #include <cstdlib>
+#include <stdint.h>
 #include <iostream>
 
 using namespace std;
 
+/*
+ * flag names packed into a 32-bit integer in file (big-endian) order
+*/
+#define ABI_FLAG( a, b, c, d )  \
+    ( ( static_cast<unsigned int>( a ) << 0x18 ) | ( static_cast<unsigned int>( b ) << 0x10 ) | \
+    ( static_cast<unsigned int>( c ) << 0x8 ) | static_cast<unsigned int>( d ) )
+
+inline unsigned int AbiFlagCode(
+    const string& _flag )
+{
+    return( ( _flag.length() < 4 ) ? 0 : ABI_FLAG( static_cast<unsigned char>( _flag[ 0 ] ),
+        static_cast<unsigned char>( _flag[ 1 ] ), static_cast<unsigned char>( _flag[ 2 ] ),
+        static_cast<unsigned char>( _flag[ 3 ] ) ) );
+}
+
+/*
+ * ABI designated data types, in the order of the type name table
+*/
+enum AbiDataType
+{
+    abiTYPE_ILLEGAL, abiTYPE_BYTE, abiTYPE_CHAR, abiTYPE_WORD, abiTYPE_SHORT, abiTYPE_LONG,
+    abiTYPE_RATIONAL, abiTYPE_FLOAT, abiTYPE_DOUBLE, abiTYPE_BCD, abiTYPE_DATE, abiTYPE_TIME,
+    abiTYPE_THUMB, abiTYPE_BOOLEAN, abiTYPE_POINT, abiTYPE_RECT, abiTYPE_VPOINT, abiTYPE_VRECT,
+    abiTYPE_PSTRING, abiTYPE_CSTRING, abiTYPE_TAG, abiTYPE_DELTALZW, abiTYPE_LZW,
+    abiTYPE_DIRECTORY, abiTYPE_USERTYPE, abiTYPE_CUSTOM
+};
+
 /*
  * all ABI FLAG records are 28 byes in length and exhibit the following structure:
+ *
+ * the record keeps exactly those 28 bytes, decoded, so a directory is one
+ * contiguous array with no allocations; the flag and type names are only
+ * built when asked for
 */
 class AbiTagRecord
 {
 public:
-    AbiTagRecord( unsigned char*, const unsigned int );
-    ~AbiTagRecord() {}
+    AbiTagRecord() {}
+    AbiTagRecord( const unsigned char*, const unsigned int );
 
-    const string& GetFlagName() const   { return( szFlagName ); }
-    const string& GetTypeName() const   { return( szTypeName ); }
+    string GetFlagName() const;
+    const string& GetTypeName() const;
 
+    unsigned int GetFlagCode() const    { return( nFlagCode ); }
     int GetFlagID() const       { return( nFlagID ); }
     int GetDataType() const     { return( nDataType ); }
     int GetRecordSize() const   { return( nRecordSize ); }
@@ -42,23 +75,18 @@ public:
     int GetDataPadding() const  { return( nDataPadding ); }
 
 private:
-    string  szTypeName;     // ABI designated data type name
-    string  szFlagName;     // ASCII flag name
-    int nFlagID;            // id of the flag
-    int nDataType;          // ABI designated data type
-    int nRecordSize;        // length of referenced data records (bytes)
-    int nRecordCount;       // number of referenced data records
-    int nRecordLength;      // length of referenced data array (bytes)
-    int nDataValue;         // either (1) the data itself or (2) a pointer
-    int nDataPadding;       // purpose is unknown
-
-    unsigned char*  szBuffer;
-    unsigned int    nEntry;
+    uint32_t nFlagCode;     // ASCII flag name packed into 4 bytes
+    int32_t nFlagID;        // id of the flag
+    uint16_t nDataType;     // ABI designated data type; AbiDataType
+    uint16_t nRecordSize;   // length of referenced data records (bytes)
+    int32_t nRecordCount;   // number of referenced data records
+    int32_t nRecordLength;  // length of referenced data array (bytes)
+    int32_t nDataValue;     // either (1) the data itself or (2) a pointer
+    int32_t nDataPadding;   // purpose is unknown
 
-    string& GetFlag( string& );
-    int GetShort();
-    int GetLong();
-    int GetDataType( int );
+    static int GetShort( const unsigned char*, unsigned int& );
+    static int GetLong( const unsigned char*, unsigned int& );
+    static AbiDataType GetDataType( int );
 };
 
 #endif  // _ABI_TAG_H
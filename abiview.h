@@ -0,0 +1,103 @@
+/*
+ * abiview.h
+ *
+ * non-owning views over the big-endian arrays of an ABI tracefile
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_VIEW_H
+#define _ABI_VIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C++ header files
+#include <iterator>
+
+#include <abidecode.h>
+
+/*
+ * a span of signed 16-bit samples stored big-endian in the tracefile buffer;
+ * nothing is copied or decoded until an element is read, and the view is
+ * only valid while the AbiFile it came from keeps the file loaded. the names
+ * follow the standard containers so the view works with the algorithms
+*/
+class AbiShortView
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef int16_t         value_type;
+        typedef ptrdiff_t       difference_type;
+        typedef const int16_t*  pointer;
+        typedef int16_t         reference;
+
+        const_iterator() : szData( NULL ) {}
+        explicit const_iterator( const unsigned char* _s ) : szData( _s ) {}
+
+        int16_t operator*() const   { return( static_cast<int16_t>( ( szData[ 0 ] << 0x8 ) | szData[ 1 ] ) ); }
+        int16_t operator[]( ptrdiff_t _n ) const    { return( *( *this + _n ) ); }
+
+        const_iterator& operator++()    { szData += 2; return( *this ); }
+        const_iterator& operator--()    { szData -= 2; return( *this ); }
+        const_iterator operator++( int )    { const_iterator i( *this ); szData += 2; return( i ); }
+        const_iterator operator--( int )    { const_iterator i( *this ); szData -= 2; return( i ); }
+        const_iterator& operator+=( ptrdiff_t _n )  { szData += 2 * _n; return( *this ); }
+        const_iterator& operator-=( ptrdiff_t _n )  { szData -= 2 * _n; return( *this ); }
+        const_iterator operator+( ptrdiff_t _n ) const  { return( const_iterator( szData + 2 * _n ) ); }
+        const_iterator operator-( ptrdiff_t _n ) const  { return( const_iterator( szData - 2 * _n ) ); }
+        ptrdiff_t operator-( const const_iterator& _i ) const   { return( ( szData - _i.szData ) / 2 ); }
+
+        bool operator==( const const_iterator& _i ) const   { return( szData == _i.szData ); }
+        bool operator!=( const const_iterator& _i ) const   { return( !( szData == _i.szData ) ); }
+        bool operator<( const const_iterator& _i ) const    { return( szData < _i.szData ); }
+        bool operator>( const const_iterator& _i ) const    { return( _i.szData < szData ); }
+        bool operator<=( const const_iterator& _i ) const   { return( !( _i.szData < szData ) ); }
+        bool operator>=( const const_iterator& _i ) const   { return( !( szData < _i.szData ) ); }
+
+    private:
+        const unsigned char* szData;
+    };
+
+    AbiShortView() : szData( NULL ), nCount( 0 ) {}
+    AbiShortView( const unsigned char* _s, size_t _n ) : szData( _s ), nCount( _n ) {}
+
+    size_t size() const     { return( nCount ); }
+    bool empty() const      { return( nCount == 0 ); }
+
+    const_iterator begin() const    { return( const_iterator( szData ) ); }
+    const_iterator end() const      { return( const_iterator( szData + 2 * nCount ) ); }
+
+    int16_t operator[]( size_t _i ) const   { return( begin()[ _i ] ); }
+    int16_t front() const   { return( ( *this )[ 0 ] ); }
+    int16_t back() const    { return( ( *this )[ nCount - 1 ] ); }
+
+    // samples [_first, _first + _count), clipped to the end of the view
+    AbiShortView subview( size_t _first, size_t _count ) const
+    {
+        _first = ( _first < nCount ) ? _first : nCount;
+        _count = ( _count < nCount - _first ) ? _count : nCount - _first;
+
+        return( AbiShortView( szData + 2 * _first, _count ) );
+    }
+
+    // decode every sample into _dst, which must hold size() elements; returns
+    // the end of the decoded range
+    int16_t* decode_into( int16_t* _dst ) const
+    {
+        AbiDecodeInt16( szData, _dst, nCount );
+
+        return( _dst + nCount );
+    }
+
+    const unsigned char* data() const   { return( szData ); }
+
+private:
+    const unsigned char* szData;    // first sample in the tracefile buffer
+    size_t nCount;                  // number of samples
+};
+
+#endif  // _ABI_VIEW_H
@@ -0,0 +1,154 @@
+/*
+ * abiwalk.cpp
+ *
+ * concurrent directory walker for finding tracefiles
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+// C++ header files
+#include <algorithm>
+
+#include <abiwalk.h>
+
+AbiDirWalker::AbiDirWalker(
+    AbiWorkPool& _pool, const VISIT& _visit ) :
+    abiPool( _pool ), fnVisit( _visit ), nFile( 0 ), nError( 0 )
+{
+}
+
+void AbiDirWalker::AddPattern(
+    const string& _pattern )
+{
+    vPattern.push_back( _pattern );
+}
+
+bool AbiDirWalker::IsMatch(
+    const char* _name ) const
+{
+    for ( size_t i = 0; i < vPattern.size(); ++i )
+    {
+        if ( fnmatch( vPattern[ i ].c_str(), _name, FNM_FILE_NAME | FNM_PERIOD ) == 0 )
+        {
+            return( true );
+        }
+    }
+
+    return( false );
+}
+
+/*
+ * start at a directory; relative paths are made absolute so the visitor
+ * gets the same kind of names no matter where the walk started
+*/
+bool AbiDirWalker::Walk(
+    const string& _root )
+{
+    string path( _root );
+
+    if ( path.empty() || !( path[ 0 ] == '/' ) )
+    {
+        char buffer[ PATH_MAX ];
+
+        if ( !getcwd( buffer, sizeof( buffer ) ) )
+        {
+            return( false );
+        }
+
+        path = ( path.empty() || path == "." ) ? string( buffer ) : string( buffer ) + "/" + path;
+    }
+
+    abiPool.Submit( [ this, path ]( int )
+    {
+        Scan( shared_ptr<DIR>(), path, path );
+    } );
+
+    return( true );
+}
+
+/*
+ * read one directory: queue a task for every subdirectory, then visit the
+ * matching files in name order. the parent stays open, through the shared
+ * pointer, until all of its subdirectories have been opened, so they are
+ * queued before the files, whose conversions would otherwise run first
+*/
+void AbiDirWalker::Scan(
+    shared_ptr<DIR> _parent, const string& _name, const string& _path )
+{
+    int fd = openat( _parent ? dirfd( _parent.get() ) : AT_FDCWD, _name.c_str(),
+        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+    DIR* p_dir = ( fd < 0 ) ? NULL : fdopendir( fd );
+
+    _parent.reset();
+
+    if ( !p_dir )
+    {
+        if ( !( fd < 0 ) )
+        {
+            close( fd );
+        }
+
+        ++nError; return;
+    }   // make sure the directory can be opened successfully
+
+    shared_ptr<DIR> dir( p_dir, closedir );
+    vector<string> file, subdir;
+    struct dirent* st_dir;
+
+    while ( ( st_dir = readdir( p_dir ) ) )
+    {
+        if ( st_dir->d_name[ 0 ] == '.' )
+        {
+            continue;
+        }   // skip the root directories and hidden files
+
+        unsigned char type = st_dir->d_type;
+
+        if ( type == DT_UNKNOWN )
+        {
+            struct stat fs;
+
+            if ( fstatat( dirfd( p_dir ), st_dir->d_name, &fs, AT_SYMLINK_NOFOLLOW ) )
+            {
+                continue;
+            }
+
+            type = S_ISDIR( fs.st_mode ) ? DT_DIR : DT_REG;
+        }   // some file systems do not fill in the type
+
+        if ( type == DT_DIR )
+        {
+            subdir.push_back( st_dir->d_name );
+        }
+        else if ( IsMatch( st_dir->d_name ) )
+        {
+            file.push_back( st_dir->d_name );
+        }
+    }   // scan through the entire directory
+
+    sort( file.begin(), file.end() );
+    sort( subdir.begin(), subdir.end() );
+
+    for ( size_t i = 0; i < subdir.size(); ++i )
+    {
+        string name = subdir[ i ], path = _path + "/" + subdir[ i ];
+
+        abiPool.Submit( [ this, dir, name, path ]( int )
+        {
+            Scan( dir, name, path );
+        } );
+    }
+
+    dir.reset();
+
+    for ( size_t i = 0; i < file.size(); ++i )
+    {
+        ++nFile; fnVisit( _path + "/" + file[ i ] );
+    }
+}   // end of Scan()
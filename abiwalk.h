@@ -0,0 +1,60 @@
+/*
+ * abiwalk.h
+ *
+ * concurrent directory walker for finding tracefiles
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_WALK_H
+#define _ABI_WALK_H
+
+#include <dirent.h>
+
+// C++ header files
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <abipool.h>
+
+using namespace std;
+
+/*
+ * walks a directory tree on a work pool, one task per directory. each
+ * directory is opened relative to its parent with openat, so the process
+ * never changes its working directory; matching files are handed to the
+ * visitor as soon as their directory has been read, while the rest of the
+ * tree is still being walked. the visitor is called from the pool workers
+*/
+class AbiDirWalker
+{
+public:
+    typedef function<void( const string& )> VISIT;
+
+    AbiDirWalker( AbiWorkPool&, const VISIT& );
+    ~AbiDirWalker() {}
+
+    void AddPattern( const string& );   // fnmatch pattern, e.g. "*.ab1"
+    bool Walk( const string& );         // queue the walk from a directory
+
+    long GetFileCount() const   { return( nFile ); }
+    long GetErrorCount() const  { return( nError ); }
+
+private:
+    AbiWorkPool&    abiPool;
+    VISIT           fnVisit;
+    vector<string>  vPattern;
+    atomic<long>    nFile;      // files handed to the visitor
+    atomic<long>    nError;     // directories that could not be read
+
+    AbiDirWalker( const AbiDirWalker& );
+    AbiDirWalker& operator=( const AbiDirWalker& );
+
+    bool IsMatch( const char* ) const;
+    void Scan( shared_ptr<DIR>, const string&, const string& );
+};
+
+#endif  // _ABI_WALK_H
@@ -0,0 +1,339 @@
+/*
+ * abiwatch.cpp
+ *
+ * watch folder for tracefiles as they are written
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <abistats.h>
+#include <abiwatch.h>
+
+// events of the folders; IN_IGNORED and IN_Q_OVERFLOW always come
+const uint32_t watchEVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE | IN_DELETE |
+    IN_MOVED_FROM | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+// longest sleep between checks of Stop, in ms
+const int watchPOLL = 250;
+
+AbiWatcher::AbiWatcher(
+    const READY& _ready, int _settle ) :
+    fnReady( _ready ), nSettle( static_cast<uint64_t>( ( _settle > 0 ) ? _settle : 0 ) * 1000000 ),
+    nNotify( inotify_init1( IN_NONBLOCK | IN_CLOEXEC ) ), nFile( 0 ), nError( 0 ), nOverflow( 0 ),
+    bStop( 0 )
+{
+}
+
+AbiWatcher::~AbiWatcher()
+{
+    if ( !( nNotify < 0 ) )
+    {
+        close( nNotify );
+    }
+}
+
+void AbiWatcher::AddPattern(
+    const string& _pattern )
+{
+    vPattern.push_back( _pattern );
+}
+
+/*
+ * hidden files are left out, as by the walker; copy tools write into them
+ * and rename the finished file
+*/
+bool AbiWatcher::IsMatch(
+    const char* _name ) const
+{
+    for ( size_t i = 0; i < vPattern.size(); ++i )
+    {
+        if ( fnmatch( vPattern[ i ].c_str(), _name, FNM_FILE_NAME | FNM_PERIOD ) == 0 )
+        {
+            return( true );
+        }
+    }
+
+    return( false );
+}
+
+/*
+ * start at a directory; relative paths are made absolute so the callback
+ * gets the same names as the visitor of the walker
+*/
+bool AbiWatcher::Watch(
+    const string& _root )
+{
+    string path( _root );
+
+    if ( nNotify < 0 )
+    {
+        return( false );
+    }
+
+    if ( path.empty() || !( path[ 0 ] == '/' ) )
+    {
+        char buffer[ PATH_MAX ];
+
+        if ( !getcwd( buffer, sizeof( buffer ) ) )
+        {
+            return( false );
+        }
+
+        path = ( path.empty() || path == "." ) ? string( buffer ) : string( buffer ) + "/" + path;
+    }
+
+    long error = nError;
+
+    AddTree( path, false );
+
+    return( nError == error );
+}
+
+/*
+ * watch a folder and the ones below it; a folder that appeared while
+ * watching may already hold finished files, so those are queued as well
+*/
+void AbiWatcher::AddTree(
+    const string& _path, bool _queue )
+{
+    int wd = inotify_add_watch( nNotify, _path.c_str(), watchEVENTS );
+
+    if ( wd < 0 )
+    {
+        ++nError; return;
+    }
+
+    mpDir[ wd ] = _path;
+
+    DIR* dir = opendir( _path.c_str() );
+    struct dirent* st_dir;
+    vector<string> subdir;
+
+    if ( !dir )
+    {
+        ++nError; return;
+    }
+
+    while ( ( st_dir = readdir( dir ) ) )
+    {
+        if ( st_dir->d_name[ 0 ] == '.' )
+        {
+            continue;
+        }
+
+        unsigned char type = st_dir->d_type;
+
+        if ( type == DT_UNKNOWN )
+        {
+            struct stat fs;
+
+            if ( fstatat( dirfd( dir ), st_dir->d_name, &fs, AT_SYMLINK_NOFOLLOW ) )
+            {
+                continue;
+            }
+
+            type = S_ISDIR( fs.st_mode ) ? DT_DIR : DT_REG;
+        }
+
+        if ( type == DT_DIR )
+        {
+            subdir.push_back( st_dir->d_name );
+        }
+        else if ( _queue && IsMatch( st_dir->d_name ) )
+        {
+            uint64_t now = AbiGetClock();
+            PENDING pending = { now, now + nSettle };
+
+            mpPending[ _path + "/" + st_dir->d_name ] = pending;
+        }
+    }
+
+    closedir( dir );
+
+    for ( size_t i = 0; i < subdir.size(); ++i )
+    {
+        AddTree( _path + "/" + subdir[ i ], _queue );
+    }
+}   // end of AddTree()
+
+/*
+ * after the kernel dropped events: queue every matching file of a watched
+ * folder again; the caller skips the ones it has already converted
+*/
+void AbiWatcher::Scan(
+    const string& _path )
+{
+    DIR* dir = opendir( _path.c_str() );
+    struct dirent* st_dir;
+
+    if ( !dir )
+    {
+        return;
+    }
+
+    while ( ( st_dir = readdir( dir ) ) )
+    {
+        if ( !( st_dir->d_name[ 0 ] == '.' ) && !( st_dir->d_type == DT_DIR ) && IsMatch( st_dir->d_name ) )
+        {
+            uint64_t now = AbiGetClock();
+            PENDING pending = { now, now + nSettle };
+
+            mpPending.insert( make_pair( _path + "/" + st_dir->d_name, pending ) );
+        }
+    }
+
+    closedir( dir );
+}
+
+void AbiWatcher::Handle(
+    int _wd, uint32_t _mask, const char* _name )
+{
+    if ( _mask & IN_Q_OVERFLOW )
+    {
+        ++nOverflow;
+
+        for ( map<int, string>::const_iterator i = mpDir.begin(); !( i == mpDir.end() ); ++i )
+        {
+            Scan( ( *i ).second );
+        }
+
+        return;
+    }
+
+    map<int, string>::iterator dir = mpDir.find( _wd );
+
+    if ( dir == mpDir.end() )
+    {
+        return;
+    }
+
+    // the folder is gone or no longer watched
+    if ( _mask & IN_IGNORED )
+    {
+        mpDir.erase( dir ); return;
+    }
+
+    string path = ( *dir ).second + "/" + _name;
+
+    if ( ( _mask & IN_ISDIR ) )
+    {
+        if ( ( _mask & ( IN_CREATE | IN_MOVED_TO ) ) && !( _name[ 0 ] == '.' ) )
+        {
+            AddTree( path, true );
+        }
+
+        return;
+    }
+
+    if ( !IsMatch( _name ) )
+    {
+        return;
+    }
+
+    uint64_t now = AbiGetClock();
+    map<string, PENDING>::iterator i = mpPending.find( path );
+
+    if ( _mask & ( IN_CLOSE_WRITE | IN_MOVED_TO ) )
+    {
+        PENDING pending = { now, now + nSettle };
+        mpPending[ path ] = pending;
+    }
+    else if ( _mask & ( IN_DELETE | IN_MOVED_FROM ) )
+    {
+        if ( !( i == mpPending.end() ) )
+        {
+            mpPending.erase( i );
+        }
+    }
+    else if ( !( i == mpPending.end() ) )
+    {
+        // written to again; wait for it to be closed once more
+        ( *i ).second.nDeadline = 0;
+    }
+}   // end of Handle()
+
+/*
+ * ms until the first pending file settles, at most watchPOLL
+*/
+int AbiWatcher::GetTimeout() const
+{
+    uint64_t now = AbiGetClock(), wait = static_cast<uint64_t>( watchPOLL ) * 1000000;
+
+    for ( map<string, PENDING>::const_iterator i = mpPending.begin(); !( i == mpPending.end() ); ++i )
+    {
+        if ( ( *i ).second.nDeadline > 0 )
+        {
+            uint64_t left = ( ( *i ).second.nDeadline > now ) ? ( *i ).second.nDeadline - now : 0;
+            wait = ( left < wait ) ? left : wait;
+        }
+    }
+
+    return( static_cast<int>( ( wait + 999999 ) / 1000000 ) );
+}
+
+/*
+ * hand over the files that have settled
+*/
+void AbiWatcher::Deliver()
+{
+    uint64_t now = AbiGetClock();
+
+    for ( map<string, PENDING>::iterator i = mpPending.begin(); !( i == mpPending.end() ); )
+    {
+        if ( ( *i ).second.nDeadline > 0 && !( ( *i ).second.nDeadline > now ) )
+        {
+            string path = ( *i ).first;
+            uint64_t closed = ( *i ).second.nClosed;
+
+            i = mpPending.erase( i );
+            ++nFile; fnReady( path, closed );
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+/*
+ * read events until Stop; the events are read in batches into a buffer
+ * aligned for struct inotify_event
+*/
+void AbiWatcher::Run()
+{
+    alignas( struct inotify_event ) char buffer[ 64 * 1024 ];
+    struct pollfd fd = { nNotify, POLLIN, 0 };
+
+    while ( !bStop && !( nNotify < 0 ) )
+    {
+        int n = poll( &fd, 1, GetTimeout() );
+
+        if ( n < 0 && !( errno == EINTR ) )
+        {
+            break;
+        }
+
+        for ( ssize_t size; n > 0 && ( size = read( nNotify, buffer, sizeof( buffer ) ) ) > 0; )
+        {
+            for ( char* p = buffer; p < buffer + size; )
+            {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>( p );
+
+                Handle( event->wd, event->mask, ( event->len > 0 ) ? event->name : "" );
+                p += sizeof( struct inotify_event ) + event->len;
+            }
+        }
+
+        Deliver();
+    }
+}   // end of Run()
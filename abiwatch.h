@@ -0,0 +1,79 @@
+/*
+ * abiwatch.h
+ *
+ * watch folder for tracefiles as they are written
+ *
+ * Department of Biological Sciences
+ * University of Idaho, Moscow, ID 83844
+*/
+#ifndef _ABI_WATCH_H
+#define _ABI_WATCH_H
+
+#include <signal.h>
+#include <stdint.h>
+
+// C++ header files
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+/*
+ * watches a tree with inotify and hands a matching file to the callback once
+ * it has been closed after writing, or moved in, and has then been left
+ * alone for the settle time; a file written to again in the meantime waits
+ * for its next close. folders created later are watched as they appear, and
+ * the files already in them are picked up as well. the callback is called
+ * from the thread running Run, with the time of the last close in ns of
+ * AbiGetClock, so the caller can tell how long the file took to convert
+*/
+class AbiWatcher
+{
+public:
+    typedef function<void( const string&, uint64_t )> READY;
+
+    AbiWatcher( const READY&, int );
+    ~AbiWatcher();
+
+    void AddPattern( const string& );   // fnmatch pattern, e.g. "*.ab1"
+    bool Watch( const string& );        // a directory and everything below it
+    void Run();         // until Stop
+    void Stop()     { bStop = 1; }      // safe to call from a signal handler
+
+    long GetWatchCount() const      { return( static_cast<long>( mpDir.size() ) ); }
+    long GetFileCount() const       { return( nFile ); }
+    long GetErrorCount() const      { return( nError ); }
+    long GetOverflowCount() const   { return( nOverflow ); }
+
+private:
+    struct PENDING
+    {
+        uint64_t nClosed;       // last close or move in
+        uint64_t nDeadline;     // ready after this; 0 while being written
+    };
+
+    READY               fnReady;
+    uint64_t            nSettle;    // ns
+    int                 nNotify;    // inotify descriptor
+    vector<string>      vPattern;
+    map<int, string>    mpDir;      // watch descriptor to folder
+    map<string, PENDING> mpPending; // files waiting to settle
+    long                nFile;      // files handed to the callback
+    long                nError;     // folders that could not be watched
+    long                nOverflow;  // times the kernel dropped events
+    volatile sig_atomic_t bStop;
+
+    AbiWatcher( const AbiWatcher& );
+    AbiWatcher& operator=( const AbiWatcher& );
+
+    bool IsMatch( const char* ) const;
+    void AddTree( const string&, bool );
+    void Scan( const string& );
+    void Handle( int, uint32_t, const char* );
+    int GetTimeout() const;
+    void Deliver();
+};
+
+#endif  // _ABI_WATCH_H